@@ -18,27 +18,520 @@
 
 	- No return values are allowed for delegate listeners.
 
+	- Arguments are never copied to hand them to listeners. Every listener
+	  sees the same arguments as const references (rvalue references too),
+	  and only listeners that take them by value make their own copy.
+	  invoke_move_last() lets the last listener move from them instead.
+
+	- Many events can be delivered at once with invoke_batch(). Listeners
+	  that would rather handle the whole batch in one go can subscribe
+	  with subscribe_batch().
+
+	- Listeners may freely subscribe, unsubscribe, destroy or move
+	  handles (their own or anyone's) while the delegate is executing.
+	  Changes made during execution behave as follows:
+	  - A removed subscription is never called again, starting immediately.
+	  - A new subscription does not receive the event in flight. It is
+	    called starting with the next execution.
+	  - A moved handle keeps its subscription exactly where it was.
+	  The bookkeeping is settled once the outermost execution finishes.
+	  If nobody changes anything during execution, none of this costs
+	  any allocations or copies.
+
+	- Subscribing an empty function does nothing, and returns an empty handle.
+
+	- Subscriptions are allocated from a std::pmr::memory_resource, the
+	  default one unless you pass your own to the constructor. Callbacks
+	  themselves never allocate.
+
+	- Coroutines can wait for the next execution with co_await next(),
+	  which gives them a copy of its arguments. Waiting needs no handle
+	  and no allocation, and waiting coroutines are resumed once the
+	  execution has finished. As with handles, the delegate must outlive
+	  the coroutines waiting on it (or they must be destroyed first).
+
+	- Every file that uses a signature (delegate<int, float>, say)
+	  compiles all of it again. To compile it once instead, see
+	  YADI_EXTERN_DELEGATE at the bottom of this file.
+
 *************************************************************************/
 
 #include "delegate_core.hpp"
+#include "delegate_instrumentation.hpp"
 
+#include <coroutine>
 #include <map>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <vector>
 
-namespace yadi
+YADI_EXPORT namespace yadi
 {
+	//The order invoke_batch() calls listeners in.
+	enum class batch_order
+	{
+		//For each event, call every listener. Same as calling the delegate once per event.
+		event_major,
+		//For each listener, deliver every event. Each listener's code and data stay hot
+		//in cache for the whole batch, but listeners no longer see events interleaved.
+		listener_major,
+	};
+
 	template<typename... Args>
 	class delegate : delegate_base
 	{
+	public:
+		//One event's worth of arguments, as taken by invoke_batch().
+		using argument_pack = std::tuple<Args...>;
+
+		class next_awaiter;
+
 	private:
 		using callback_type = void(Args...);
+		using batch_callback_type = void(std::span<argument_pack const>);
+
+		/*
+		* The subscriptions of one kind (regular or batch). Listeners may subscribe and unsubscribe
+		* while the delegate is executing, which would otherwise invalidate the map iterators being
+		* used to execute it. Instead, while dispatching:
+		*	- removed subscriptions are only flagged (tombstoned), and skipped from then on
+		*	- new subscriptions wait in m_pending, so they don't receive the event in flight
+		* and compact() applies all of that once the outermost execution finishes.
+		* Moving a handle never gets here at all, see the notes on delegate_handle.
+		*/
+		template<typename Callback>
+		class listener_set
+		{
+		public:
+			struct listener
+			{
+				Callback callback;
+				bool removed{ false };
+				YADI_NO_UNIQUE_ADDRESS instrumentation::listener_record stats;
+			};
+
+			//std::map is used because there is no point in optimizing the execution of these functions
+			//calling a bunch of "random" functions already wreaks havoc on cache locality
+			//instead, it makes far more sense to optimize for search/remove/insert
+			//Keys count up as listeners subscribe, so they are called in subscription order.
+			using map_type = std::pmr::map<uint64_t, listener>;
+
+		private:
+			map_type m_active;
+			map_type m_pending;
+			size_t m_removedCount{ 0 };
+
+		public:
+			listener_set() = default;
+
+			explicit listener_set(std::pmr::memory_resource* resource)
+				: m_active{ resource }, m_pending{ resource }
+			{
+			}
+
+			map_type& active()
+			{
+				return m_active;
+			}
+
+			size_t size() const
+			{
+				return m_active.size() - m_removedCount + m_pending.size();
+			}
+
+			//the bytes this set has allocated, with map nodes estimated (see util::node_size)
+			size_t memory_usage() const
+			{
+				return (m_active.size() + m_pending.size()) * util::node_size<typename map_type::value_type>;
+			}
+
+			void add(uint64_t key, Callback&& callback, bool dispatching, uint64_t id)
+			{
+				(dispatching ? m_pending : m_active).emplace(key, listener{ std::move(callback), false, instrumentation::listener_record{ id } });
+			}
+
+			bool remove(uint64_t key, bool dispatching)
+			{
+				if (!dispatching)
+				{
+					return m_active.erase(key) != 0;
+				}
+
+				auto entry{ m_active.find(key) };
+				if (entry != m_active.end() && !entry->second.removed)
+				{
+					entry->second.removed = true;
+					++m_removedCount;
+					return true;
+				}
+				return m_pending.erase(key) != 0;
+			}
+
+			//removes the listeners with the given keys, which must be sorted (key_of(i) is the i'th).
+			//Must not be used while dispatching.
+			template<typename KeyOf>
+			void remove_sorted(size_t count, KeyOf const& key_of)
+			{
+				//once a decent share of the map is going, one walk over it beats a lookup per key
+				if (count * 8 < m_active.size())
+				{
+					for (size_t i{ 0 }; i < count; ++i)
+					{
+						m_active.erase(key_of(i));
+					}
+					return;
+				}
+
+				auto entry{ m_active.begin() };
+				for (size_t i{ 0 }; i < count && entry != m_active.end(); ++i)
+				{
+					uint64_t const key{ key_of(i) };
+					while (entry != m_active.end() && entry->first < key)
+					{
+						++entry;
+					}
+					if (entry != m_active.end() && entry->first == key)
+					{
+						entry = m_active.erase(entry);
+					}
+				}
+			}
+
+			//apply everything that was put off while dispatching
+			void compact()
+			{
+				if (m_removedCount != 0)
+				{
+					std::erase_if(m_active, [](auto const& entry) { return entry.second.removed; });
+					m_removedCount = 0;
+				}
+
+				m_active.merge(m_pending);
+			}
+
+			//calls visit(stats) for every live subscription, for instrumentation
+			template<typename F>
+			void visit(F const& visit)
+			{
+				for (auto& entry : m_active)
+				{
+					if (!entry.second.removed)
+					{
+						visit(entry.second.stats);
+					}
+				}
+				for (auto& entry : m_pending)
+				{
+					visit(entry.second.stats);
+				}
+			}
+
+			//removes every subscription
+			void clear(bool dispatching)
+			{
+				m_pending.clear();
+				if (dispatching)
+				{
+					for (auto& entry : m_active)
+					{
+						entry.second.removed = true;
+					}
+					m_removedCount = m_active.size();
+				}
+				else
+				{
+					m_active.clear();
+				}
+			}
+		};
+
+		listener_set<util::inplace_function<callback_type>> m_callbacks;
+		//listeners that receive every batch at once, see subscribe_batch()
+		listener_set<util::inplace_function<batch_callback_type>> m_batchCallbacks;
+
+		//the key of the next subscription. Its handle keeps the top half as its slot, and the bottom half as its generation.
+		uint64_t m_nextKey{ 0 };
+		//what our handles are bound to, made on the first subscription
+		handle_anchor<delegate>* m_anchor{ nullptr };
+		friend class handle_anchor<delegate>;
+
+		//how many executions of this delegate are currently running (more than one if a listener executes it again)
+		unsigned m_dispatchDepth{ 0 };
+
+		//An intrusive list of awaiters, linked through the awaiters themselves (which live in coroutine frames).
+		struct awaiter_list
+		{
+			next_awaiter* first{ nullptr };
+			next_awaiter* last{ nullptr };
+
+			void push_back(next_awaiter* awaiter)
+			{
+				awaiter->m_list = this;
+				awaiter->m_previous = last;
+				awaiter->m_next = nullptr;
+				(last ? last->m_next : first) = awaiter;
+				last = awaiter;
+			}
+
+			void remove(next_awaiter* awaiter)
+			{
+				(awaiter->m_previous ? awaiter->m_previous->m_next : first) = awaiter->m_next;
+				(awaiter->m_next ? awaiter->m_next->m_previous : last) = awaiter->m_previous;
+				awaiter->m_list = nullptr;
+			}
+		};
+
+		//coroutines waiting for the next execution
+		awaiter_list m_waiting;
+		//coroutines that have their event, waiting for the outermost execution to finish
+		awaiter_list m_ready;
+
+		//hands the arguments of the execution that's starting to everything waiting for it
+		template<typename... Ts>
+		void fill_waiters(Ts const&... args)
+		{
+			while (next_awaiter* const awaiter{ m_waiting.first })
+			{
+				m_waiting.remove(awaiter);
+				awaiter->m_event.emplace(args...);
+				m_ready.push_back(awaiter);
+			}
+		}
+
+		void resume_waiters()
+		{
+			//a resumed coroutine may wait again (that goes in m_waiting), execute the delegate, or destroy other waiters
+			while (next_awaiter* const awaiter{ m_ready.first })
+			{
+				m_ready.remove(awaiter);
+				awaiter->m_coroutine.resume();
+			}
+		}
+
+		//see delegate_instrumentation.hpp. Takes no space unless YADI_INSTRUMENTATION is on.
+		YADI_NO_UNIQUE_ADDRESS instrumentation::delegate_record m_stats;
+
+		using listener_type = typename listener_set<util::inplace_function<callback_type>>::listener;
+
+		void call_listener(listener_type& listener, util::param_t<Args>... args)
+		{
+			[[maybe_unused]] auto const listenerTimer{ m_stats.time_listener(listener.stats) };
+			listener.callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+		}
+
+		void call_batch_listeners(argument_pack const& pack)
+		{
+			//batch listeners see this as a batch of one
+			for (auto& entry : m_batchCallbacks.active())
+			{
+				if (!entry.second.removed)
+				{
+					[[maybe_unused]] auto const listenerTimer{ m_stats.time_listener(entry.second.stats) };
+					entry.second.callback(std::span<argument_pack const>{ &pack, 1 });
+				}
+			}
+		}
+
+		/*
+		* Shared by operator() and invoke_move_last().
+		*
+		* Template params:
+		*	- MoveLast
+		*		Whether the last listener to see the arguments may move from them.
+		*/
+		template<bool MoveLast>
+		void dispatch(util::param_t<Args>... args)
+		{
+			dispatch_scope scope{ *this };
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+			if (m_waiting.first)
+			{
+				//before any listener can move from the arguments
+				fill_waiters(args...);
+			}
+
+			//with MoveLast, each listener is held back until the next live one turns up,
+			//so whichever is still held at the end is known to be the last
+			listener_type* held{ nullptr };
+			for (auto& entry : m_callbacks.active())
+			{
+				if (entry.second.removed)
+				{
+					continue;
+				}
+				if constexpr (MoveLast)
+				{
+					if (held)
+					{
+						call_listener(*held, std::forward<util::param_t<Args>>(args)...);
+					}
+					//the held listener may just have removed this one
+					held = entry.second.removed ? nullptr : &entry.second;
+				}
+				else
+				{
+					call_listener(entry.second, std::forward<util::param_t<Args>>(args)...);
+				}
+			}
+
+			bool const hasBatchListeners{ m_batchCallbacks.size() != 0 };
+			if constexpr (MoveLast)
+			{
+				if (held && !held->removed)
+				{
+					if (hasBatchListeners)
+					{
+						call_listener(*held, std::forward<util::param_t<Args>>(args)...);
+					}
+					else
+					{
+						[[maybe_unused]] auto const listenerTimer{ m_stats.time_listener(held->stats) };
+						held->callback.call_consuming(std::forward<util::param_t<Args>>(args)...);
+					}
+				}
+				if (hasBatchListeners)
+				{
+					//the batch listeners come last, so the arguments are moved into their pack
+					argument_pack const pack{ util::take_param<Args>(args)... };
+					call_batch_listeners(pack);
+				}
+			}
+			else if (hasBatchListeners)
+			{
+				argument_pack const pack{ std::forward<util::param_t<Args>>(args)... };
+				call_batch_listeners(pack);
+			}
+		}
+
+		//lets the instrumentation registry find our listeners
+		void bind_instrumentation()
+		{
+			m_stats.bind_listeners(this, [](void* owner, auto const& visit)
+			{
+				static_cast<delegate*>(owner)->m_callbacks.visit(visit);
+				static_cast<delegate*>(owner)->m_batchCallbacks.visit(visit);
+			});
+		}
+
+		struct dispatch_scope
+		{
+			delegate& owner;
+
+			explicit dispatch_scope(delegate& dispatching)
+				: owner{ dispatching }
+			{
+				++owner.m_dispatchDepth;
+			}
+
+			~dispatch_scope()
+			{
+				if (--owner.m_dispatchDepth == 0)
+				{
+					owner.m_callbacks.compact();
+					owner.m_batchCallbacks.compact();
+					owner.resume_waiters();
+				}
+			}
+		};
+
+		bool is_dispatching() const
+		{
+			return m_dispatchDepth != 0;
+		}
+
+		handle_anchor<delegate>& anchor()
+		{
+			if (!m_anchor)
+			{
+				m_anchor = new handle_anchor<delegate>{ this };
+			}
+			return *m_anchor;
+		}
+
+		static uint64_t key_of(delegate_handle const& handle)
+		{
+			return uint64_t{ handle_slot(handle) } << 32 | handle_generation(handle);
+		}
+
+		template<typename Set, typename Callback>
+		delegate_handle add_entry(Set& callbacks, Callback&& fn)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				//nothing to call
+				return handle;
+			}
+			//the handle is found by its key, wherever it moves to
+			uint64_t const key{ m_nextKey++ };
+			callbacks.add(key, std::move(fn), is_dispatching(), m_stats.next_listener_id());
+			anchor().attach(handle, static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+			return handle;
+		}
+
+		//see handle_anchor. A cleared subscription's key is never handed out again, so a stale handle finds nothing.
+		void release_slot(uint32_t slot, uint32_t generation)
+		{
+			uint64_t const key{ uint64_t{ slot } << 32 | generation };
+			if (!m_callbacks.remove(key, is_dispatching()))
+			{
+				m_batchCallbacks.remove(key, is_dispatching());
+			}
+		}
 
-		//std::map is used because there is no point in optimizing the execution of these functions
-		//calling a bunch of "random" functions already wreaks havoc on cache locality
-		//instead, it makes far more sense to optimize for search/remove/insert
-		std::map<delegate_handle*, std::function<callback_type>> m_callbacks;
+		//see handle_anchor. Sorting by slot, then generation, sorts by key.
+		void release_batch(delegate_handle* const* handles, size_t count)
+		{
+			if (is_dispatching())
+			{
+				//the tombstones need the usual bookkeeping
+				for (size_t i{ 0 }; i < count; ++i)
+				{
+					release_slot(handle_slot(*handles[i]), handle_generation(*handles[i]));
+				}
+				return;
+			}
+
+			auto const key{ [handles](size_t i) { return key_of(*handles[i]); } };
+			m_callbacks.remove_sorted(count, key);
+			if (m_batchCallbacks.size() != 0)
+			{
+				m_batchCallbacks.remove_sorted(count, key);
+			}
+		}
 
 	public:
-		delegate() = default;
+		delegate()
+		{
+			bind_instrumentation();
+		}
+
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate subscriptions from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the delegate.
+		*/
+		explicit delegate(std::pmr::memory_resource* resource)
+			: m_callbacks{ resource }, m_batchCallbacks{ resource }
+		{
+			bind_instrumentation();
+		}
+
+		//handles are bound to the delegate's anchor, which a copy couldn't share
+		delegate(delegate const&) = delete;
+		delegate& operator=(delegate const&) = delete;
+
+		//handles that outlive the delegate keep its anchor alive, rather than pointing at the delegate
+		~delegate()
+		{
+			if (m_anchor)
+			{
+				m_anchor->orphan();
+			}
+		}
 
 		/*
 		* Given a member function pointer (&Coffee::Brew) and a pointer to an instance,
@@ -58,10 +551,7 @@ namespace yadi
 		template<typename T>
 		delegate_handle subscribe(void(T::* fn)(Args...), T* instance)
 		{
-			delegate_handle handle;
-			m_callbacks.emplace(&handle, util::attach(fn, instance));
-			notify_handle_subscribed(handle);
-			return handle;
+			return add_entry(m_callbacks, util::attach(fn, instance));
 		}
 
 		/*
@@ -86,26 +576,78 @@ namespace yadi
 			return subscribe(fn, &instance);
 		}
 
+		/*
+		* Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->Fn(Args...).
+		*
+		* Prefer this over passing the member function pointer as an argument where you can.
+		* The call to Fn gets inlined into the stored callback, so there's no member function pointer
+		* to decode every time the delegate runs.
+		*
+		* Template params:
+		*	- Fn
+		*		The member function to subscribe. It must be callable on T with the delegate's arguments.
+		*
+		* Params:
+		*	- instance
+		*		A pointer to the object to call the function on.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T* instance)
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), T*, Args...>, "yadi::delegate: Fn can't be called on T with this delegate's arguments.");
+			return subscribe(util::member_caller<Fn, T>{ instance });
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T& instance)
+		{
+			return subscribe<Fn>(&instance);
+		}
+
+		/*
+		* Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done Fn(Args...).
+		*
+		* Template params:
+		*	- Fn
+		*		The function to subscribe. It must be callable with the delegate's arguments.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn>
+		delegate_handle subscribe()
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), Args...>, "yadi::delegate: Fn can't be called with this delegate's arguments.");
+			return subscribe(util::free_caller<Fn>{});
+		}
+
 		/*
 		* Given any function object (lambda, function pointer, functor, etc), subscribe it to this delegate.
 		* The resulting call from the delegate will be the same as if you had done fn(Args...).
 		*
 		* Params:
 		* 	- fn
-		*		The function to call. This can be any type that will construct a valid std::function.
-		*		That includes function pointers, lambdas, and other functors.
+		*		The function to call. This can be any type that will construct a valid util::inplace_function.
+		*		That includes function pointers, lambdas, and other functors, as long as their captures fit
+		*		in YADI_INPLACE_FUNCTION_CAPACITY bytes. Subscribing never allocates memory for the function itself.
 		*
 		* Returns:
 		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
 		*	See the delegate_handle notes in delegate_core.hpp for more details.
 		*/
-		delegate_handle subscribe(std::function<callback_type> const& fn)
+		delegate_handle subscribe(util::inplace_function<callback_type> fn)
 		{
-			delegate_handle handle;
-			//delegate_handle move ctor will ensure this entry stays valid
-			m_callbacks.emplace(&handle, fn);
-			notify_handle_subscribed(handle);
-			return handle;
+			return add_entry(m_callbacks, std::move(fn));
 		}
 
 		/*
@@ -119,64 +661,236 @@ namespace yadi
 		*/
 		void unsubscribe(delegate_handle& handle) override
 		{
-			auto entry{ m_callbacks.find(&handle) };
-			if (entry != m_callbacks.end())
+			if (m_anchor)
 			{
-				m_callbacks.erase(entry);
-				notify_handle_unsubscribed(handle);
+				m_anchor->unsubscribe(handle);
 			}
 		}
 
+		//Handles from this delegate carry their key with them, and move without calling this.
+		void move_subscription(delegate_handle&, delegate_handle&) override
+		{
+		}
+
+		//Execute the underlying delegate, passing along the appropriate args.
+		//This calls all subscribed functions.
+		//Arguments are passed to every listener as they are, without being copied or moved.
+		//Listeners may subscribe, unsubscribe, move handles, and even execute the delegate again while it runs.
+		//See the notes on the class for exactly what they will see.
+		void operator()(util::param_t<Args>... args)
+		{
+			dispatch<false>(std::forward<util::param_t<Args>>(args)...);
+		}
+
 		/*
-		* Transfers ownership of a delegate subscription from one handle to another.
-		* This assumes that the old handle is connected to this delegate already.
-		* If it isn't, calling this has no effect.
+		* Same as executing the delegate, except that the last listener to be called gets to move
+		* from arguments taken by value, instead of copying them. Use this to hand off a big
+		* argument (a std::vector, say) that nobody needs once the delegate has run.
+		* If there are batch listeners, the arguments are moved into the batch of one they get instead.
 		*
 		* Params:
-		*	- old_handle
-		*		The handle to move the subscription away from. This handle should be subscribed to this delegate already.
-		*	- new_handle
-		*		The handle to move the subscription to. If it already owns another subscription, that one will be removed.
+		*	- args
+		*		The arguments. Pass the ones worth moving with std::move().
 		*/
-		void move_subscription(delegate_handle& old_handle, delegate_handle& new_handle) override
+		void invoke_move_last(Args... args)
 		{
-			//Additionally, this is a very good template for how to implement this function in other delegate implementations.
-			//This isn't part of the base class to allow flexibility in what underlying container you want to use.
-			auto entry{ m_callbacks.extract(&old_handle) };
-			if (!entry.empty())
-			{
-				notify_handle_unsubscribed(old_handle);
-				entry.key() = &new_handle;
-				m_callbacks.insert(std::move(entry));
-				notify_handle_subscribed(new_handle);
-			}
+			dispatch<true>(std::forward<Args>(args)...);
 		}
 
-		//Execute the underlying delegate, passing along the appropriate args.
-		//This calls all subscribed functions.
-		void operator()(Args... args)
+		/*
+		* Deliver many events at once. This is equivalent to executing the delegate once per event,
+		* except that listeners subscribed with subscribe_batch() are called once with the whole batch,
+		* after everyone else.
+		*
+		* Params:
+		*	- batch
+		*		The arguments for each event.
+		*	- order
+		*		batch_order::listener_major lets each listener handle every event before moving on to the next
+		*		listener, which is friendlier to the cache. Only use it if your listeners don't care about
+		*		seeing each event's listeners run back to back.
+		*/
+		void invoke_batch(std::span<argument_pack const> batch, batch_order order = batch_order::event_major)
 		{
-			for (auto& entry : m_callbacks)
+			dispatch_scope scope{ *this };
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+			if (m_waiting.first && !batch.empty())
+			{
+				//waiters get the first event
+				std::apply([this](auto const&... args) { fill_waiters(args...); }, batch.front());
+			}
+			if (order == batch_order::event_major)
+			{
+				for (auto const& pack : batch)
+				{
+					for (auto& entry : m_callbacks.active())
+					{
+						if (!entry.second.removed)
+						{
+							std::apply([this, &entry](auto&&... values) { call_listener(entry.second, values...); }, pack);
+						}
+					}
+				}
+			}
+			else
 			{
-				entry.second(std::forward<Args>(args)...);
+				for (auto& entry : m_callbacks.active())
+				{
+					for (auto const& pack : batch)
+					{
+						//check every time, the listener may unsubscribe partway through
+						if (!entry.second.removed)
+						{
+							std::apply([this, &entry](auto&&... values) { call_listener(entry.second, values...); }, pack);
+						}
+					}
+				}
 			}
+
+			for (auto& entry : m_batchCallbacks.active())
+			{
+				if (!entry.second.removed)
+				{
+					[[maybe_unused]] auto const listenerTimer{ m_stats.time_listener(entry.second.stats) };
+					entry.second.callback(batch);
+				}
+			}
+		}
+
+		/*
+		* Subscribe a function that handles a whole batch of events at once.
+		* It receives every batch given to invoke_batch(), and single executions of the delegate
+		* as a batch of one. Useful for listeners that can vectorize over the events.
+		*
+		* Params:
+		*	- fn
+		*		The function to call. It must accept a std::span<std::tuple<Args...> const>.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe_batch(util::inplace_function<batch_callback_type> fn)
+		{
+			return add_entry(m_batchCallbacks, std::move(fn));
+		}
+
+		/*
+		* Waits for the next execution of the delegate, in a coroutine: auto [x, y] = co_await on_move.next();
+		* The coroutine is resumed once that execution has finished, after every listener has run.
+		*
+		* Returns:
+		*	An awaitable. co_await gives nothing if the delegate has no arguments, a copy of the argument
+		*	if it has one, and a std::tuple of copies of them otherwise. References are copied as values.
+		*/
+		next_awaiter next()
+		{
+			return next_awaiter{ *this };
 		}
 
 		//Returns the number of functions currently subscribed to this delegate.
 		size_t subscriber_count() const
 		{
-			return m_callbacks.size();
+			return m_callbacks.size() + m_batchCallbacks.size();
 		}
 
-		//Force-removes all subscribers from this delegate immediately.
+		//Returns roughly how many bytes this delegate has allocated for its subscriptions, on top of sizeof(delegate).
+		//Each subscription is one std::map node, whose size can only be estimated (see util::node_size).
+		size_t memory_usage() const
+		{
+			return m_callbacks.memory_usage() + m_batchCallbacks.memory_usage();
+		}
+
+		//Name this delegate in instrumentation reports. Does nothing unless YADI_INSTRUMENTATION is on.
+		void set_name(std::string name)
+		{
+			m_stats.set_name(std::move(name));
+		}
+
+		//Turn per-listener timing on or off, see delegate_instrumentation.hpp.
+		//Does nothing unless YADI_INSTRUMENTATION is on.
+		void set_listener_timing(bool enabled)
+		{
+			m_stats.set_listener_timing(enabled);
+		}
+
+		//Force-removes all subscribers from this delegate immediately. Their handles are left harmless, see handle_anchor.
+		//If the delegate is executing, no more listeners will be called.
 		void clear_all_subscriptions()
 		{
-			for (auto& item : m_callbacks)
+			m_callbacks.clear(is_dispatching());
+			m_batchCallbacks.clear(is_dispatching());
+		}
+	};
+
+	/*
+	* What delegate::next() returns. It lives in the waiting coroutine's frame, and is linked into
+	* the delegate while the coroutine waits, so waiting never allocates. Destroying the coroutine
+	* while it waits is fine, it unlinks itself.
+	*/
+	template<typename... Args>
+	class delegate<Args...>::next_awaiter
+	{
+	private:
+		friend class delegate;
+
+		delegate& m_owner;
+		//the list this is currently linked into, if any
+		awaiter_list* m_list{ nullptr };
+		next_awaiter* m_previous{ nullptr };
+		next_awaiter* m_next{ nullptr };
+		std::coroutine_handle<> m_coroutine;
+		std::optional<std::tuple<std::decay_t<Args>...>> m_event;
+
+		explicit next_awaiter(delegate& owner)
+			: m_owner{ owner }
+		{
+		}
+
+	public:
+		//linked by address
+		next_awaiter(next_awaiter const&) = delete;
+		next_awaiter& operator=(next_awaiter const&) = delete;
+
+		~next_awaiter()
+		{
+			if (m_list)
+			{
+				m_list->remove(this);
+			}
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> coroutine)
+		{
+			m_coroutine = coroutine;
+			m_owner.m_waiting.push_back(this);
+		}
+
+		auto await_resume()
+		{
+			if constexpr (sizeof...(Args) == 1)
+			{
+				return std::get<0>(std::move(*m_event));
+			}
+			else if constexpr (sizeof...(Args) > 1)
 			{
-				notify_handle_unsubscribed(*item.first);
+				return std::move(*m_event);
 			}
-			m_callbacks.clear();
 		}
 	};
 }
+
+//Explicit instantiation, to compile a delegate signature once instead of in every file that uses it.
+//Declare it where every user of the signature can see it (a shared or precompiled header):
+//	YADI_EXTERN_DELEGATE(int, float);
+//then instantiate it in exactly one source file:
+//	YADI_INSTANTIATE_DELEGATE(int, float);
+//For the usual signatures all at once, see YADI_COMMON_SIGNATURES in delegate_core.hpp.
+#define YADI_EXTERN_DELEGATE(...) extern template class yadi::delegate<__VA_ARGS__>
+#define YADI_INSTANTIATE_DELEGATE(...) template class yadi::delegate<__VA_ARGS__>
 #endif
@@ -0,0 +1,533 @@
+#ifndef YADI_DELEGATE_AFFINITY_H
+#define YADI_DELEGATE_AFFINITY_H
+/************************************************************************
+ delegate_affinity :
+	This contains the functionality for the yadi::affinity_delegate and
+	yadi::executor_queue classes.
+	yadi::affinity_delegate has the following restrictions and features:
+
+	- It is used like yadi::delegate, and hands out the same
+	  delegate_handle objects. Each subscribe() can also take the
+	  executor_queue the listener has to run on, such as the render or
+	  audio thread's. Listeners without one run on whichever thread
+	  executes the delegate, as usual.
+
+	- Executing the delegate calls the listeners with no executor, and
+	  those whose executor belongs to the executing thread, right away.
+	  Every other executor gets its listeners' calls as one task per
+	  event, however many of its listeners there are. That thread runs
+	  them all when it calls run_pending() on its queue.
+
+	- Arguments for queued calls are copied once per event, into one
+	  allocation shared by every executor, and references are stored as
+	  values. Executing with no calls to queue doesn't allocate.
+
+	- Snapshots, listeners and queued arguments all come from the memory
+	  resource given to the constructor. Any thread executing the
+	  delegate or running its calls may allocate or free from it, so it
+	  must be thread-safe (std::pmr::synchronized_pool_resource, say).
+
+	- Any thread may execute the delegate, subscribe, unsubscribe, or
+	  destroy/move a handle, all at the same time. Subscribing builds a
+	  new snapshot of the listeners, the same way concurrent_delegate
+	  does, so changes are relatively expensive.
+
+	- A listener that is unsubscribed is never called again, even if a
+	  call to it is already queued, unless that call has already started
+	  on its executor's thread. Unsubscribing on the listener's own
+	  executor thread is therefore always safe.
+
+	- Listeners run on their executor in the order they subscribed.
+	  Nothing is promised about the order between executors.
+
+	- executor_queues must outlive the subscriptions that use them.
+	  Destroying the delegate detaches its handles, so they may outlive
+	  it, but not race with its destruction.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	//A queue of calls for one thread to run, see affinity_delegate.
+	class executor_queue
+	{
+	public:
+		using task_type = util::inplace_function<void()>;
+
+	private:
+		mutable std::mutex m_lock;
+		std::vector<task_type> m_tasks;
+		//the tasks being run. Only the thread in run_pending() touches these.
+		std::vector<task_type> m_running;
+		bool m_isRunning{ false };
+		std::atomic<std::thread::id> m_thread;
+
+		//Puts back what the last run_pending() took, however it ends.
+		struct run_scope
+		{
+			executor_queue* owner;
+
+			~run_scope()
+			{
+				owner->m_running.clear();
+				owner->m_isRunning = false;
+			}
+		};
+
+	public:
+		//the queue belongs to the thread that creates it, until bind_to_current_thread() says otherwise
+		executor_queue()
+			: m_thread{ std::this_thread::get_id() }
+		{
+		}
+
+		executor_queue(executor_queue const&) = delete;
+		executor_queue& operator=(executor_queue const&) = delete;
+
+		//Make the calling thread the one this queue's listeners run on.
+		//Executing a delegate from that thread calls them right away instead of queuing them.
+		void bind_to_current_thread()
+		{
+			m_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		}
+
+		//Returns whether the calling thread is the one this queue belongs to.
+		bool runs_here() const
+		{
+			return m_thread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+		}
+
+		//Queue a task to run at the next run_pending(). Safe to call from any thread.
+		void post(task_type task)
+		{
+			std::lock_guard<std::mutex> lock{ m_lock };
+			m_tasks.push_back(std::move(task));
+		}
+
+		/*
+		* Run every task queued so far, in the order they were posted.
+		* Call this from the thread the queue belongs to. Tasks posted while this runs wait for the next call,
+		* and calling it from one of its own tasks does nothing.
+		*
+		* Returns:
+		*	The number of tasks run.
+		*/
+		size_t run_pending()
+		{
+			if (m_isRunning)
+			{
+				return 0;
+			}
+
+			m_isRunning = true;
+			run_scope const scope{ this };
+			{
+				std::lock_guard<std::mutex> lock{ m_lock };
+				m_running.swap(m_tasks);
+			}
+
+			for (task_type& task : m_running)
+			{
+				task();
+			}
+			return m_running.size();
+		}
+
+		//Returns how many tasks are waiting for the next run_pending().
+		size_t pending() const
+		{
+			std::lock_guard<std::mutex> lock{ m_lock };
+			return m_tasks.size();
+		}
+	};
+
+	template<typename... Args>
+	class affinity_delegate : delegate_base
+	{
+	private:
+		using callback_type = void(Args...);
+		using event_type = std::tuple<std::decay_t<Args>...>;
+
+		//Shared by every snapshot it's in, and by queued calls, so unsubscribing can stop those.
+		struct listener
+		{
+			//only touched with m_writeLock held
+			delegate_handle* handle;
+			executor_queue* executor;
+			util::inplace_function<callback_type> callback;
+			std::atomic<bool> subscribed{ true };
+
+			listener(delegate_handle* owner, executor_queue* queue, util::inplace_function<callback_type>&& fn)
+				: handle{ owner }, executor{ queue }, callback{ std::move(fn) }
+			{
+			}
+		};
+
+		//never modified after being published. Listeners with the same executor are kept
+		//next to each other, in the order they subscribed, with the ones without one first.
+		using snapshot = std::pmr::vector<std::shared_ptr<listener>>;
+
+		//What the calls queued for one event share: the listeners to call, and a copy of the arguments.
+		struct queued_event
+		{
+			std::shared_ptr<snapshot const> listeners;
+			event_type event;
+
+			template<typename... Ts>
+			explicit queued_event(std::shared_ptr<snapshot const> const& current, Ts&&... args)
+				: listeners{ current }, event(std::forward<Ts>(args)...)
+			{
+			}
+
+			//call the listeners in [begin, end), which all share one executor
+			void run(size_t begin, size_t end)
+			{
+				for (size_t i{ begin }; i < end; ++i)
+				{
+					listener const& item{ *(*listeners)[i] };
+					if (item.subscribed.load(std::memory_order_acquire))
+					{
+						std::apply([&item](auto&... values) { item.callback.call_shared(values...); }, event);
+					}
+				}
+			}
+		};
+
+		//The listeners that executing threads should use. null means nobody is subscribed.
+		std::atomic<std::shared_ptr<snapshot const>> m_current;
+		std::atomic<size_t> m_count{ 0 };
+
+		//Only serializes writers against each other. Never taken while executing.
+		std::mutex m_writeLock;
+		std::pmr::memory_resource* m_resource;
+
+		//The following expect m_writeLock to be held.
+
+		snapshot const& current_listeners() const
+		{
+			static snapshot const empty;
+			//only writers replace the snapshot, so this one stays alive while the lock is held
+			snapshot const* current{ m_current.load(std::memory_order_relaxed).get() };
+			return current ? *current : empty;
+		}
+
+		void publish(snapshot&& next)
+		{
+			m_count.store(next.size(), std::memory_order_relaxed);
+			m_current.store(next.empty() ? nullptr
+				: std::allocate_shared<snapshot>(std::pmr::polymorphic_allocator<snapshot>{ m_resource }, std::move(next)), std::memory_order_release);
+		}
+
+		delegate_handle add_callback(util::inplace_function<callback_type>&& fn, executor_queue* executor)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				//nothing to call
+				return handle;
+			}
+			//unlocked before returning, since moving the handle out (without NRVO) locks again in move_subscription
+			{
+				std::lock_guard<std::mutex> lock{ m_writeLock };
+
+				snapshot const& listeners{ current_listeners() };
+				//after the last listener on the same executor, or at the end of the ones with none
+				auto position{ std::find_if(listeners.rbegin(), listeners.rend(),
+					[executor](auto const& item) { return item->executor == executor; }).base() };
+				if (position == listeners.begin() && executor)
+				{
+					position = listeners.end();
+				}
+
+				snapshot next{ m_resource };
+				next.reserve(listeners.size() + 1);
+				next.insert(next.end(), listeners.begin(), position);
+				next.push_back(std::allocate_shared<listener>(std::pmr::polymorphic_allocator<listener>{ m_resource }, &handle, executor, std::move(fn)));
+				next.insert(next.end(), position, listeners.end());
+				publish(std::move(next));
+
+				notify_handle_subscribed(handle);
+			}
+			return handle;
+		}
+
+		//see delegate_base::unsubscribe_batch. Publishes one snapshot for the whole batch.
+		void unsubscribe_batch(delegate_handle* const* handles, size_t count) override
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			snapshot const& listeners{ current_listeners() };
+			snapshot next{ m_resource };
+			next.reserve(listeners.size());
+			for (auto const& item : listeners)
+			{
+				if (std::binary_search(handles, handles + count, item->handle, std::less<>{}))
+				{
+					item->subscribed.store(false, std::memory_order_release);
+					notify_handle_unsubscribed(*item->handle);
+				}
+				else
+				{
+					next.push_back(item);
+				}
+			}
+
+			if (next.size() != listeners.size())
+			{
+				publish(std::move(next));
+			}
+		}
+
+	public:
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate snapshots, listeners and queued arguments from. Every thread executing
+		*		the delegate or running its queued calls uses it, so it must be thread-safe.
+		*		It must outlive the delegate, and any of its calls still queued.
+		*/
+		explicit affinity_delegate(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_resource{ resource }
+		{
+		}
+
+		affinity_delegate(affinity_delegate const&) = delete;
+		affinity_delegate& operator=(affinity_delegate const&) = delete;
+
+		//Handles that outlive the delegate are detached, rather than left pointing at it.
+		//Calls still queued are dropped, but keep what they need alive.
+		~affinity_delegate()
+		{
+			clear_all_subscriptions();
+		}
+
+		/*
+		* Given a member function pointer (&Coffee::Brew) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The member function to subscribe. Its signature must match the one provided by the delegate.
+		*	- instance
+		*		A pointer to the object to call the function on. It must be valid to call the given member function on it.
+		*	- executor
+		*		The queue of the thread the function must run on, or null to run on whichever thread executes the delegate.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename T>
+		delegate_handle subscribe(void(T::* fn)(Args...), T* instance, executor_queue* executor = nullptr)
+		{
+			return add_callback(util::attach(fn, instance), executor);
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<typename T>
+		delegate_handle subscribe(void(T::* fn)(Args...), T& instance, executor_queue* executor = nullptr)
+		{
+			return subscribe(fn, &instance, executor);
+		}
+
+		//Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		//subscribe that function to this delegate, to run on executor (or inline, if that's null).
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T* instance, executor_queue* executor = nullptr)
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), T*, Args...>, "yadi::affinity_delegate: Fn can't be called on T with this delegate's arguments.");
+			return add_callback(util::member_caller<Fn, T>{ instance }, executor);
+		}
+
+		//Same as above, but takes the instance by reference.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T& instance, executor_queue* executor = nullptr)
+		{
+			return subscribe<Fn>(&instance, executor);
+		}
+
+		//Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate,
+		//to run on executor (or inline, if that's null).
+		template<auto Fn>
+		delegate_handle subscribe(executor_queue* executor = nullptr)
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), Args...>, "yadi::affinity_delegate: Fn can't be called with this delegate's arguments.");
+			return add_callback(util::free_caller<Fn>{}, executor);
+		}
+
+		/*
+		* Given any function object (lambda, function pointer, functor, etc), subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The function to call. This can be any type that will construct a valid util::inplace_function.
+		*		Subscribing an empty function does nothing, and returns an empty handle.
+		*	- executor
+		*		The queue of the thread fn must run on, or null to run on whichever thread executes the delegate.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe(util::inplace_function<callback_type> fn, executor_queue* executor = nullptr)
+		{
+			return add_callback(std::move(fn), executor);
+		}
+
+		/*
+		* Given a delegate_handle (representing a valid subscription),
+		* remove the subscription and deactivate the handle. If the
+		* handle doesn't belong to this delegate, do nothing.
+		*
+		* Calls already queued for the listener are dropped. Threads executing
+		* the delegate, or running its queued calls, right now may still call it once more.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*/
+		void unsubscribe(delegate_handle& handle) override
+		{
+			delegate_handle* const handles[]{ &handle };
+			unsubscribe_batch(handles, 1);
+		}
+
+		/*
+		* Transfers ownership of a delegate subscription from one handle to another.
+		* This assumes that the old handle is connected to this delegate already.
+		* If it isn't, calling this has no effect.
+		*
+		* Params:
+		*	- old_handle
+		*		The handle to move the subscription away from. This handle should be subscribed to this delegate already.
+		*	- new_handle
+		*		The handle to move the subscription to. If it already owns another subscription, that one will be removed.
+		*/
+		void move_subscription(delegate_handle& old_handle, delegate_handle& new_handle) override
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			//listeners are shared between snapshots, so this needs no new one
+			for (auto const& item : current_listeners())
+			{
+				if (item->handle == &old_handle)
+				{
+					item->handle = &new_handle;
+					notify_handle_unsubscribed(old_handle);
+					notify_handle_subscribed(new_handle);
+					return;
+				}
+			}
+		}
+
+		/*
+		* Execute the delegate. Listeners without an executor, or whose executor belongs to this thread,
+		* are called right away, with the arguments as they are. Each other executor gets one task
+		* for all of its listeners, sharing one copy of the arguments.
+		* Never blocks, except briefly to queue those tasks.
+		*/
+		void operator()(util::param_t<Args>... args)
+		{
+			std::shared_ptr<snapshot const> const listeners{ m_current.load(std::memory_order_acquire) };
+			if (!listeners)
+			{
+				return;
+			}
+
+			//only made if some executor needs it
+			std::shared_ptr<queued_event> queued;
+			size_t const count{ listeners->size() };
+			size_t begin{ 0 };
+			while (begin < count)
+			{
+				executor_queue* const executor{ (*listeners)[begin]->executor };
+				size_t end{ begin + 1 };
+				while (end < count && (*listeners)[end]->executor == executor)
+				{
+					++end;
+				}
+
+				if (!executor || executor->runs_here())
+				{
+					for (size_t i{ begin }; i < end; ++i)
+					{
+						listener const& item{ *(*listeners)[i] };
+						if (item.subscribed.load(std::memory_order_acquire))
+						{
+							item.callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+						}
+					}
+				}
+				else
+				{
+					if (!queued)
+					{
+						queued = std::allocate_shared<queued_event>(std::pmr::polymorphic_allocator<queued_event>{ m_resource }, listeners, args...);
+					}
+					executor->post([queued, begin, end]() { queued->run(begin, end); });
+				}
+				begin = end;
+			}
+		}
+
+		//Returns the number of functions currently subscribed to this delegate.
+		size_t subscriber_count() const
+		{
+			return m_count.load(std::memory_order_relaxed);
+		}
+
+		//Returns roughly how many bytes this delegate has allocated, on top of sizeof(affinity_delegate): the current
+		//snapshot, and a listener each. Older snapshots, kept alive by queued calls, belong to those calls.
+		size_t memory_usage() const
+		{
+			//the same snapshot executing threads would see, kept alive while we look at it
+			std::shared_ptr<snapshot const> const current{ m_current.load(std::memory_order_acquire) };
+			if (!current)
+			{
+				return 0;
+			}
+			snapshot const& listeners{ *current };
+			//std::allocate_shared keeps the reference counts next to the object, estimated as two pointers
+			constexpr size_t shared_overhead{ 2 * sizeof(void*) };
+			return sizeof(snapshot) + shared_overhead + listeners.capacity() * sizeof(std::shared_ptr<listener>)
+				+ listeners.size() * (sizeof(listener) + shared_overhead);
+		}
+
+		/*
+		* Force-removes all subscribers from this delegate immediately, and drops their queued calls.
+		* This writes to every handle, so it must not race with those handles
+		* being moved or destroyed on other threads.
+		*/
+		void clear_all_subscriptions()
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			for (auto const& item : current_listeners())
+			{
+				item->subscribed.store(false, std::memory_order_release);
+				notify_handle_unsubscribed(*item->handle);
+			}
+			publish(snapshot{ m_resource });
+		}
+	};
+}
+#endif
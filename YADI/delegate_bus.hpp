@@ -0,0 +1,246 @@
+#ifndef YADI_DELEGATE_BUS_H
+#define YADI_DELEGATE_BUS_H
+/************************************************************************
+ delegate_bus :
+	This contains the functionality for the yadi::event_bus class.
+	yadi::event_bus has the following restrictions and features:
+
+	- It routes events by type: subscribe<Explosion>(...) listens for
+	  every publish(Explosion{...}). Any type can be an event.
+
+	- Each event type gets a small, dense index the first time any bus
+	  sees it. A bus keeps one yadi::delegate_fast<E const&> per event
+	  type in an array by that index, so publishing is an array lookup
+	  and a walk over that type's listeners. Nothing is hashed.
+
+	- The delegate for a type is only created once something subscribes
+	  to it. Publishing an event nobody listens to costs a bounds check.
+
+	- Subscribing hands out the usual delegate_handle objects, and the
+	  same subscribe() overloads as yadi::delegate_fast.
+
+	- Events are routed by their exact type: publishing a type derived
+	  from E does not reach listeners of E.
+
+	- The same rules as yadi::delegate_fast apply per event type: the
+	  order listeners are called in is not stable, and listeners must
+	  not subscribe to or unsubscribe from the type being published.
+	  Publishing other events from a listener is fine.
+
+	- It is not thread-safe. Event type indexes are handed out safely
+	  from any thread, though.
+
+	- Indexes are per program, so with shared libraries, an event type
+	  may get a different index in each library. Publish and subscribe
+	  from code linked into the same binary.
+
+*************************************************************************/
+
+#include "delegate_fast.hpp"
+
+#include <atomic>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	namespace util
+	{
+		//Hands out a dense index for each type, starting from 0, in the order they are first asked about.
+		class type_index
+		{
+		private:
+			static size_t next()
+			{
+				static std::atomic<size_t> counter{ 0 };
+				return counter.fetch_add(1, std::memory_order_relaxed);
+			}
+
+		public:
+			template<typename T>
+			static size_t of()
+			{
+				static size_t const index{ next() };
+				return index;
+			}
+		};
+	}
+
+	class event_bus
+	{
+	private:
+		//lets channels of every event type share one array
+		struct channel_base
+		{
+			//destroys this channel and frees its memory
+			virtual void destroy(std::pmr::polymorphic_allocator<> allocator) = 0;
+
+			//the bytes this channel takes up, its delegate's allocations included
+			virtual size_t memory_usage() const = 0;
+
+		protected:
+			~channel_base() = default;
+		};
+
+		template<typename E>
+		struct channel final : channel_base
+		{
+			delegate_fast<E const&> listeners;
+
+			explicit channel(std::pmr::memory_resource* resource)
+				: listeners{ resource }
+			{
+			}
+
+			void destroy(std::pmr::polymorphic_allocator<> allocator) override
+			{
+				allocator.delete_object(this);
+			}
+
+			size_t memory_usage() const override
+			{
+				return sizeof(channel) + listeners.memory_usage();
+			}
+		};
+
+		template<typename E>
+		using event_type = std::remove_cvref_t<E>;
+
+		std::pmr::memory_resource* m_resource;
+		//indexed by util::type_index, null for types nobody has subscribed to
+		std::pmr::vector<channel_base*> m_channels;
+
+		//returns the delegate for E, or null if nobody has subscribed to E yet
+		template<typename E>
+		delegate_fast<E const&>* find()
+		{
+			size_t const index{ util::type_index::of<E>() };
+			if (index >= m_channels.size() || !m_channels[index])
+			{
+				return nullptr;
+			}
+			return &static_cast<channel<E>*>(m_channels[index])->listeners;
+		}
+
+		//returns the delegate for E, creating it if needed
+		template<typename E>
+		delegate_fast<E const&>& get()
+		{
+			size_t const index{ util::type_index::of<E>() };
+			if (index >= m_channels.size())
+			{
+				m_channels.resize(index + 1, nullptr);
+			}
+			if (!m_channels[index])
+			{
+				std::pmr::polymorphic_allocator<> allocator{ m_resource };
+				m_channels[index] = allocator.new_object<channel<E>>(m_resource);
+			}
+			return static_cast<channel<E>*>(m_channels[index])->listeners;
+		}
+
+	public:
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate the per-type delegates and their subscriptions from
+		*		(see subscription_pool in delegate_pool.hpp). It must outlive the bus.
+		*/
+		explicit event_bus(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_resource{ resource }, m_channels{ resource }
+		{
+		}
+
+		//handles point into the bus, so it stays put
+		event_bus(event_bus const&) = delete;
+		event_bus& operator=(event_bus const&) = delete;
+
+		~event_bus()
+		{
+			std::pmr::polymorphic_allocator<> allocator{ m_resource };
+			for (channel_base* item : m_channels)
+			{
+				if (item)
+				{
+					item->destroy(allocator);
+				}
+			}
+		}
+
+		/*
+		* Subscribe to every event of type E. This takes the same arguments as
+		* delegate_fast<E const&>::subscribe: a member function and an instance, or any function object.
+		*
+		* Template params:
+		*	- E
+		*		The event type to listen for.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename E, typename... Ts>
+		delegate_handle subscribe(Ts&&... args)
+		{
+			return get<event_type<E>>().subscribe(std::forward<Ts>(args)...);
+		}
+
+		//Same as delegate_fast::subscribe<Fn>, for events of type E: subscribe<Explosion, &Camera::shake>(&camera).
+		template<typename E, auto Fn, typename... Instance>
+		delegate_handle subscribe(Instance&&... instance)
+		{
+			return get<event_type<E>>().template subscribe<Fn>(std::forward<Instance>(instance)...);
+		}
+
+		/*
+		* Deliver an event to everything subscribed to its type.
+		*
+		* Params:
+		*	- event
+		*		The event. Listeners get it by const reference, it is never copied.
+		*/
+		template<typename E>
+		void publish(E const& event)
+		{
+			if (auto* listeners{ find<E>() })
+			{
+				(*listeners)(event);
+			}
+		}
+
+		//Returns the number of functions currently subscribed to events of type E.
+		template<typename E>
+		size_t subscriber_count()
+		{
+			auto* const listeners{ find<event_type<E>>() };
+			return listeners ? listeners->subscriber_count() : 0;
+		}
+
+		//Returns the bytes this bus has allocated, on top of sizeof(event_bus): a delegate_fast for every
+		//event type anyone has subscribed to, with its subscriptions, and the array they're found through.
+		size_t memory_usage() const
+		{
+			size_t total{ m_channels.capacity() * sizeof(channel_base*) };
+			for (channel_base const* item : m_channels)
+			{
+				if (item)
+				{
+					total += item->memory_usage();
+				}
+			}
+			return total;
+		}
+
+		//Force-removes every subscription to events of type E.
+		template<typename E>
+		void clear_subscriptions()
+		{
+			if (auto* listeners{ find<event_type<E>>() })
+			{
+				listeners->clear_all_subscriptions();
+			}
+		}
+	};
+}
+#endif
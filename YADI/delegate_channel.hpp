@@ -0,0 +1,353 @@
+#ifndef YADI_DELEGATE_CHANNEL_H
+#define YADI_DELEGATE_CHANNEL_H
+/************************************************************************
+ delegate_channel :
+	This contains the functionality for the yadi::delegate_channel class.
+	yadi::delegate_channel has the following restrictions and features:
+
+	- It is a yadi::delegate, owned by one thread (the consumer).
+	  Subscribing, handles, and executing it immediately all work exactly
+	  the same, from that thread only.
+
+	- Additionally, any number of other threads may post() events to it
+	  at any time. Events wait in a fixed-size ring until the consumer
+	  calls pump(), which delivers them to the listeners, in the order
+	  they were posted, on the consumer's thread.
+
+	- Posting never locks and never allocates. The ring is allocated once,
+	  when the channel is constructed.
+
+	- When the ring is full, what post() does is up to the channel's
+	  overflow_policy: drop the new event, drop the oldest one to make
+	  room, or wait for the consumer to make room.
+
+	- stats() reports how many events were posted, delivered and dropped,
+	  and the most events that were ever waiting at once, so the ring can
+	  be sized from real numbers.
+
+	- Arguments are copied (or moved) when posted, and references are
+	  stored as values. Listeners can take them over: the last listener
+	  to see an event may move from it.
+
+*************************************************************************/
+
+#include "delegate.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	//What delegate_channel::post() does when the ring is full.
+	enum class overflow_policy
+	{
+		//the new event is thrown away, and post() returns false
+		drop_newest,
+		//the oldest waiting event is thrown away to make room. One at most per post(): if the consumer
+		//is still delivering the event in the way, post() waits for it instead of dropping more
+		drop_oldest,
+		//post() waits until the consumer makes room. Never post from the consumer's own thread with this.
+		wait,
+	};
+
+	//See delegate_channel::stats().
+	struct channel_stats
+	{
+		uint64_t posted{ 0 };
+		uint64_t delivered{ 0 };
+		uint64_t dropped{ 0 };
+		//the most events that were ever waiting at once
+		size_t high_water{ 0 };
+	};
+
+	template<typename... Args>
+	class delegate_channel : public delegate<Args...>
+	{
+	private:
+		using event_type = std::tuple<std::decay_t<Args>...>;
+
+		//keeps the producers' and the consumer's counters from sharing a cache line
+		static constexpr size_t cache_line{ 64 };
+
+		//A bounded multi-producer queue, after Dmitry Vyukov's.
+		//Each cell's sequence says whose turn it is: equal to a position means free for the
+		//producer claiming that position, one past it means full and ready for the consumer.
+		struct cell
+		{
+			std::atomic<size_t> sequence{ 0 };
+			alignas(event_type) unsigned char storage[sizeof(event_type)];
+
+			event_type* event()
+			{
+				return std::launder(reinterpret_cast<event_type*>(storage));
+			}
+		};
+
+		std::pmr::vector<cell> m_cells;
+		size_t m_mask;
+		overflow_policy m_policy;
+
+		alignas(cache_line) std::atomic<size_t> m_tail{ 0 };
+		std::atomic<uint64_t> m_posted{ 0 };
+		std::atomic<uint64_t> m_dropped{ 0 };
+		std::atomic<size_t> m_highWater{ 0 };
+
+		alignas(cache_line) std::atomic<size_t> m_head{ 0 };
+		std::atomic<uint64_t> m_delivered{ 0 };
+
+		static size_t round_capacity(size_t capacity)
+		{
+			size_t rounded{ 2 };
+			while (rounded < capacity)
+			{
+				rounded <<= 1;
+			}
+			return rounded;
+		}
+
+		//claims a free cell, or returns null if the ring is full
+		cell* claim(size_t& position)
+		{
+			position = m_tail.load(std::memory_order_relaxed);
+			while (true)
+			{
+				cell& item{ m_cells[position & m_mask] };
+				size_t const sequence{ item.sequence.load(std::memory_order_acquire) };
+				auto const difference{ static_cast<std::make_signed_t<size_t>>(sequence - position) };
+				if (difference == 0)
+				{
+					if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						return &item;
+					}
+				}
+				else if (difference < 0)
+				{
+					return nullptr;
+				}
+				else
+				{
+					position = m_tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/*
+		* Take the oldest waiting event out of the ring.
+		* The consumer does this, and so do producers making room under drop_oldest.
+		*
+		* Params:
+		*	- consume
+		*		Called with the event before it's destroyed.
+		*
+		* Returns:
+		*	false if the ring was empty.
+		*/
+		template<typename F>
+		bool take(F&& consume)
+		{
+			size_t position{ m_head.load(std::memory_order_relaxed) };
+			cell* item;
+			while (true)
+			{
+				item = &m_cells[position & m_mask];
+				size_t const sequence{ item->sequence.load(std::memory_order_acquire) };
+				auto const difference{ static_cast<std::make_signed_t<size_t>>(sequence - (position + 1)) };
+				if (difference == 0)
+				{
+					if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false;
+				}
+				else
+				{
+					position = m_head.load(std::memory_order_relaxed);
+				}
+			}
+
+			event_type* const event{ item->event() };
+			consume(*event);
+			event->~event_type();
+			//the cell is free for whoever claims it one lap from now
+			item->sequence.store(position + m_mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		void note_depth(size_t position)
+		{
+			//the consumer may already be past this event
+			size_t const head{ m_head.load(std::memory_order_relaxed) };
+			size_t const depth{ head <= position ? position + 1 - head : 0 };
+			size_t seen{ m_highWater.load(std::memory_order_relaxed) };
+			while (depth > seen && !m_highWater.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+			{
+			}
+		}
+
+	public:
+		/*
+		* Params:
+		*	- capacity
+		*		How many events can wait at once. Rounded up to a power of two (at least 2).
+		*	- policy
+		*		What post() does when the ring is full, see yadi::overflow_policy.
+		*	- resource
+		*		Where to allocate subscriptions and the ring from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the channel. The ring is only allocated once, here.
+		*/
+		explicit delegate_channel(size_t capacity, overflow_policy policy = overflow_policy::drop_newest,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: delegate<Args...>{ resource }, m_cells(round_capacity(capacity), resource), m_mask{ m_cells.size() - 1 }, m_policy{ policy }
+		{
+			for (size_t i{ 0 }; i < m_cells.size(); ++i)
+			{
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		delegate_channel(delegate_channel const&) = delete;
+		delegate_channel& operator=(delegate_channel const&) = delete;
+
+		//events still waiting are thrown away, without being delivered
+		~delegate_channel()
+		{
+			while (take([](event_type&) {}))
+			{
+			}
+		}
+
+		/*
+		* Record an event, to be delivered to all listeners at the consumer's next pump().
+		* Safe to call from any thread. Never locks or allocates.
+		*
+		* Params:
+		*	- args
+		*		The event's arguments. These are copied (or moved) into the ring.
+		*
+		* Returns:
+		*	false if the ring was full and the event was dropped (only with overflow_policy::drop_newest).
+		*/
+		template<typename... Ts>
+		bool post(Ts&&... args)
+		{
+			size_t position;
+			cell* item{ claim(position) };
+			bool droppedOldest{ false };
+			while (!item)
+			{
+				switch (m_policy)
+				{
+				case overflow_policy::drop_newest:
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				case overflow_policy::drop_oldest:
+					//the cell still in the way may be one the consumer is delivering right now,
+					//and taking more events wouldn't free it
+					if (!droppedOldest && take([](event_type&) {}))
+					{
+						m_dropped.fetch_add(1, std::memory_order_relaxed);
+						droppedOldest = true;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+					break;
+				case overflow_policy::wait:
+					std::this_thread::yield();
+					break;
+				}
+				item = claim(position);
+			}
+
+			::new (static_cast<void*>(item->storage)) event_type(std::forward<Ts>(args)...);
+			item->sequence.store(position + 1, std::memory_order_release);
+
+			m_posted.fetch_add(1, std::memory_order_relaxed);
+			note_depth(position);
+			return true;
+		}
+
+		/*
+		* Deliver waiting events to every listener, in the order they were posted.
+		* Only call this from the consumer's thread.
+		*
+		* Params:
+		*	- max_events
+		*		The most events to deliver. By default, as many as the ring holds, so that
+		*		producers that never stop posting can't keep pump() from returning.
+		*
+		* Returns:
+		*	The number of events delivered.
+		*/
+		size_t pump(size_t max_events = std::numeric_limits<size_t>::max())
+		{
+			if (max_events > m_cells.size())
+			{
+				max_events = m_cells.size();
+			}
+
+			size_t delivered{ 0 };
+			while (delivered < max_events && take([this](event_type& event)
+				{
+					//nobody needs the event afterwards, so the last listener can have it
+					std::apply([this](auto&... args) { this->invoke_move_last(util::take_param<Args>(args)...); }, event);
+				}))
+			{
+				++delivered;
+			}
+			m_delivered.fetch_add(delivered, std::memory_order_relaxed);
+			return delivered;
+		}
+
+		//Returns roughly how many events are waiting. Exact if nobody is posting or pumping.
+		size_t depth() const
+		{
+			size_t const head{ m_head.load(std::memory_order_relaxed) };
+			size_t const tail{ m_tail.load(std::memory_order_relaxed) };
+			return tail > head ? tail - head : 0;
+		}
+
+		//Returns how many events can wait at once.
+		size_t capacity() const
+		{
+			return m_cells.size();
+		}
+
+		//Returns roughly how many bytes this has allocated, on top of sizeof(delegate_channel): the subscriptions
+		//(see delegate::memory_usage) and the ring. Memory the events themselves point to isn't counted.
+		size_t memory_usage() const
+		{
+			return delegate<Args...>::memory_usage() + m_cells.capacity() * sizeof(cell);
+		}
+
+		overflow_policy policy() const
+		{
+			return m_policy;
+		}
+
+		//Returns a snapshot of the channel's counters. Safe to call from any thread.
+		channel_stats stats() const
+		{
+			channel_stats result;
+			result.posted = m_posted.load(std::memory_order_relaxed);
+			result.delivered = m_delivered.load(std::memory_order_relaxed);
+			result.dropped = m_dropped.load(std::memory_order_relaxed);
+			result.high_water = m_highWater.load(std::memory_order_relaxed);
+			return result;
+		}
+	};
+}
+#endif
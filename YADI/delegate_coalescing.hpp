@@ -0,0 +1,408 @@
+#ifndef YADI_DELEGATE_COALESCING_H
+#define YADI_DELEGATE_COALESCING_H
+/************************************************************************
+ delegate_coalescing :
+	This contains the functionality for the yadi::coalescing_delegate and
+	yadi::keyed_coalescing_delegate classes.
+	They have the following restrictions and features:
+
+	- Each is a yadi::delegate. Subscribing, handles, and executing it
+	  immediately all work exactly the same.
+
+	- Additionally, raise() records an event without calling anyone.
+	  Raising again before the next flush() doesn't add another event,
+	  it folds into the one already waiting, so however many times it
+	  was raised, flush() calls the listeners once.
+
+	- How raises fold together is up to the coalesce_policy: the last
+	  raise's arguments win, the first raise's arguments win, or a
+	  reducer merges each raise into the waiting event.
+
+	- keyed_coalescing_delegate<Key, Args...> keeps one waiting event per
+	  key, and flush() delivers each of them once, in the order their
+	  keys were first raised. Its listeners get the key first.
+
+	- stats() counts how many raises there were, and how many of them
+	  were folded away instead of being dispatched.
+
+	- Events raised by listeners while flushing wait for the next flush.
+	  Calling flush() from one of its own listeners does nothing.
+
+	- Arguments are copied (or moved) when raised, and references are
+	  stored as values. The last listener to see an event may move from
+	  it, as with delegate::invoke_move_last().
+
+	- Raising never allocates for coalescing_delegate. The keyed one
+	  allocates the first time each key waits, from its memory resource.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	//How raising an event that's already waiting changes it.
+	enum class coalesce_policy
+	{
+		//the waiting event takes the new raise's arguments
+		last_wins,
+		//the waiting event keeps the arguments it was first raised with
+		first_wins,
+		//a reducer merges the new raise's arguments into the waiting event
+		reduce,
+	};
+
+	//See coalescing_delegate::stats().
+	struct coalesce_stats
+	{
+		uint64_t raised{ 0 };
+		uint64_t dispatched{ 0 };
+		//raises that folded into an event already waiting, instead of being dispatched on their own
+		uint64_t elided{ 0 };
+	};
+
+	namespace util
+	{
+		//What the coalescing delegates share: how raises fold into a waiting event, and the counters.
+		template<typename... Args>
+		class coalescer
+		{
+		public:
+			using event_type = std::tuple<std::decay_t<Args>...>;
+			//gets the waiting event's arguments to change, then the new raise's arguments
+			using reducer_type = inplace_function<void(std::decay_t<Args>&..., param_t<Args>...)>;
+
+		private:
+			coalesce_policy m_policy;
+			reducer_type m_reducer;
+			coalesce_stats m_stats;
+
+		public:
+			explicit coalescer(coalesce_policy policy)
+				: m_policy{ policy }
+			{
+			}
+
+			//an empty reducer means last_wins
+			explicit coalescer(reducer_type&& reducer)
+				: m_policy{ reducer ? coalesce_policy::reduce : coalesce_policy::last_wins }, m_reducer{ std::move(reducer) }
+			{
+			}
+
+			//counts a raise that starts a new waiting event
+			void note_raised()
+			{
+				++m_stats.raised;
+			}
+
+			//counts a waiting event being delivered
+			void note_dispatched()
+			{
+				++m_stats.dispatched;
+			}
+
+			//folds a raise into the event already waiting
+			template<typename... Ts>
+			void merge(event_type& pending, Ts&&... args)
+			{
+				++m_stats.raised;
+				++m_stats.elided;
+				switch (m_policy)
+				{
+				case coalesce_policy::last_wins:
+					//assigned element by element, so the waiting values can reuse what they own
+					pending = std::forward_as_tuple(std::forward<Ts>(args)...);
+					break;
+				case coalesce_policy::first_wins:
+					break;
+				case coalesce_policy::reduce:
+					std::apply([this, &args...](auto&... values) { m_reducer(values..., std::forward<Ts>(args)...); }, pending);
+					break;
+				}
+			}
+
+			coalesce_policy policy() const
+			{
+				return m_policy;
+			}
+
+			coalesce_stats const& stats() const
+			{
+				return m_stats;
+			}
+		};
+	}
+
+	template<typename... Args>
+	class coalescing_delegate : public delegate<Args...>
+	{
+	private:
+		using coalescer_type = util::coalescer<Args...>;
+		using event_type = typename coalescer_type::event_type;
+
+		coalescer_type m_coalescer;
+		std::optional<event_type> m_pending;
+		bool m_isFlushing{ false };
+
+		//Lets flush() run again, however the flush ends.
+		struct flush_scope
+		{
+			coalescing_delegate* owner;
+
+			~flush_scope()
+			{
+				owner->m_isFlushing = false;
+			}
+		};
+
+	public:
+		using reducer_type = typename coalescer_type::reducer_type;
+
+		/*
+		* Params:
+		*	- policy
+		*		How raises fold into the waiting event. Use the reducer constructor for coalesce_policy::reduce.
+		*	- resource
+		*		Where to allocate subscriptions from (see subscription_pool in delegate_pool.hpp). It must outlive the delegate.
+		*/
+		explicit coalescing_delegate(coalesce_policy policy = coalesce_policy::last_wins,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: delegate<Args...>{ resource }, m_coalescer{ policy }
+		{
+		}
+
+		/*
+		* Params:
+		*	- reducer
+		*		Called for every raise after the first, with the waiting event's arguments to change,
+		*		then the new raise's arguments. For example, to add up damage:
+		*		[](int& total, int const& amount) { total += amount; }
+		*	- resource
+		*		Where to allocate subscriptions from. It must outlive the delegate.
+		*/
+		explicit coalescing_delegate(reducer_type reducer, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: delegate<Args...>{ resource }, m_coalescer{ std::move(reducer) }
+		{
+		}
+
+		coalescing_delegate(coalescing_delegate const&) = delete;
+		coalescing_delegate& operator=(coalescing_delegate const&) = delete;
+
+		/*
+		* Record an event, to be delivered to all listeners at the next flush().
+		* If one is already waiting, this folds into it instead, as the policy says.
+		*
+		* Params:
+		*	- args
+		*		The event's arguments. These are copied (or moved) into the waiting event.
+		*/
+		template<typename... Ts>
+		void raise(Ts&&... args)
+		{
+			if (m_pending)
+			{
+				m_coalescer.merge(*m_pending, std::forward<Ts>(args)...);
+			}
+			else
+			{
+				m_pending.emplace(std::forward<Ts>(args)...);
+				m_coalescer.note_raised();
+			}
+		}
+
+		/*
+		* Deliver the waiting event, if there is one, to every listener.
+		* Does nothing when called from one of its own listeners.
+		*
+		* Returns:
+		*	false if there was nothing waiting, or nothing was delivered.
+		*/
+		bool flush()
+		{
+			if (!m_pending || m_isFlushing)
+			{
+				return false;
+			}
+
+			//taken out first, so listeners can raise the next one
+			m_isFlushing = true;
+			flush_scope const scope{ this };
+			event_type event{ std::move(*m_pending) };
+			m_pending.reset();
+			m_coalescer.note_dispatched();
+			std::apply([this](auto&... args) { this->invoke_move_last(util::take_param<Args>(args)...); }, event);
+			return true;
+		}
+
+		//Returns whether an event is waiting for the next flush().
+		bool is_pending() const
+		{
+			return m_pending.has_value();
+		}
+
+		coalesce_policy policy() const
+		{
+			return m_coalescer.policy();
+		}
+
+		//Returns how many times this was raised, how many events were delivered, and how many raises were folded away.
+		coalesce_stats stats() const
+		{
+			return m_coalescer.stats();
+		}
+	};
+
+	template<typename Key, typename... Args>
+	class keyed_coalescing_delegate : public delegate<Key, Args...>
+	{
+	private:
+		using coalescer_type = util::coalescer<Args...>;
+		using event_type = typename coalescer_type::event_type;
+
+		struct pending_event
+		{
+			Key key;
+			event_type event;
+		};
+
+		coalescer_type m_coalescer;
+		//in the order their keys were first raised
+		std::pmr::vector<pending_event> m_pending;
+		//where a flush moves the waiting events to while it delivers them, kept to reuse its memory
+		std::pmr::vector<pending_event> m_flushing;
+		//where each key's event is in m_pending
+		std::pmr::unordered_map<Key, size_t> m_index;
+		bool m_isFlushing{ false };
+
+		//Empties out the events a flush took, however the flush ends.
+		struct flush_scope
+		{
+			keyed_coalescing_delegate* owner;
+
+			~flush_scope()
+			{
+				owner->m_flushing.clear();
+				owner->m_isFlushing = false;
+			}
+		};
+
+	public:
+		using reducer_type = typename coalescer_type::reducer_type;
+
+		/*
+		* Params:
+		*	- policy
+		*		How raises of the same key fold into its waiting event. Use the reducer constructor for coalesce_policy::reduce.
+		*	- resource
+		*		Where to allocate subscriptions and waiting events from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the delegate.
+		*/
+		explicit keyed_coalescing_delegate(coalesce_policy policy = coalesce_policy::last_wins,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: delegate<Key, Args...>{ resource }, m_coalescer{ policy }, m_pending{ resource }, m_flushing{ resource }, m_index{ resource }
+		{
+		}
+
+		//Same as coalescing_delegate's. The reducer doesn't get the key.
+		explicit keyed_coalescing_delegate(reducer_type reducer, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: delegate<Key, Args...>{ resource }, m_coalescer{ std::move(reducer) }, m_pending{ resource }, m_flushing{ resource }, m_index{ resource }
+		{
+		}
+
+		keyed_coalescing_delegate(keyed_coalescing_delegate const&) = delete;
+		keyed_coalescing_delegate& operator=(keyed_coalescing_delegate const&) = delete;
+
+		/*
+		* Record an event for key, to be delivered to all listeners at the next flush().
+		* If one is already waiting for key, this folds into it instead, as the policy says.
+		*
+		* Params:
+		*	- key
+		*		Which event this is. Raises of different keys never fold together.
+		*	- args
+		*		The event's arguments. These are copied (or moved) into the waiting event.
+		*/
+		template<typename... Ts>
+		void raise(Key const& key, Ts&&... args)
+		{
+			auto const [found, inserted] { m_index.try_emplace(key, m_pending.size()) };
+			if (inserted)
+			{
+				m_pending.push_back(pending_event{ key, event_type(std::forward<Ts>(args)...) });
+				m_coalescer.note_raised();
+			}
+			else
+			{
+				m_coalescer.merge(m_pending[found->second].event, std::forward<Ts>(args)...);
+			}
+		}
+
+		/*
+		* Deliver every waiting event to every listener, once per key, in the order their keys were first raised.
+		* Does nothing when called from one of its own listeners.
+		*
+		* Returns:
+		*	The number of events delivered.
+		*/
+		size_t flush()
+		{
+			if (m_isFlushing)
+			{
+				return 0;
+			}
+
+			//swapped out first, so listeners can raise the next ones
+			m_isFlushing = true;
+			flush_scope const scope{ this };
+			m_pending.swap(m_flushing);
+			m_index.clear();
+
+			for (pending_event& item : m_flushing)
+			{
+				m_coalescer.note_dispatched();
+				std::apply([this, &item](auto&... args)
+				{
+					this->invoke_move_last(util::take_param<Key>(item.key), util::take_param<Args>(args)...);
+				}, item.event);
+			}
+			return m_flushing.size();
+		}
+
+		//Returns how many keys have an event waiting for the next flush().
+		size_t pending_count() const
+		{
+			return m_pending.size();
+		}
+
+		//Returns roughly how many bytes this has allocated, on top of sizeof(keyed_coalescing_delegate): the subscriptions
+		//(see delegate::memory_usage), and the waiting events and their index. Memory the events point to isn't counted.
+		size_t memory_usage() const
+		{
+			return delegate<Key, Args...>::memory_usage() + (m_pending.capacity() + m_flushing.capacity()) * sizeof(pending_event)
+				+ m_index.size() * util::node_size<typename decltype(m_index)::value_type> + m_index.bucket_count() * sizeof(void*);
+		}
+
+		coalesce_policy policy() const
+		{
+			return m_coalescer.policy();
+		}
+
+		//Returns how many times this was raised, how many events were delivered, and how many raises were folded away.
+		coalesce_stats stats() const
+		{
+			return m_coalescer.stats();
+		}
+	};
+}
+#endif
@@ -0,0 +1,345 @@
+#ifndef YADI_DELEGATE_COMPACT_H
+#define YADI_DELEGATE_COMPACT_H
+/************************************************************************
+ delegate_compact :
+	This contains the functionality for the yadi::compact_delegate class.
+	yadi::compact_delegate has the following restrictions and features:
+
+	- It hands out the same delegate_handle objects as yadi::delegate,
+	  and is meant for delegates with a great many subscriptions, where
+	  the memory they take matters more than what they can call.
+
+	- Each subscription is one 24 byte entry (on 64-bit targets) in one
+	  array: a thunk, one pointer's worth of target, and its handle's
+	  address. There is no per-subscription allocation, and no side table.
+
+	- So listeners are limited to what fits in a pointer:
+	  - member functions known at compile time, subscribe<&T::fn>(instance)
+	  - free functions known at compile time, subscribe<&fn>()
+	  - function pointers, and lambdas capturing at most one pointer
+	    or reference (anything trivially copyable that fits in a pointer)
+	  Member function pointers only known at runtime don't fit. Use
+	  yadi::delegate_fast for those, or for bigger captures.
+
+	- Handles hold their entry's position, so unsubscribing and moving
+	  a handle are constant time. Clearing or destroying the delegate
+	  detaches every handle.
+
+	- Unsubscribing leaves a hole, which the next subscription fills, so
+	  the order listeners are called in is NOT stable. Subscriptions made
+	  while executing are moved into the holes once it's done, so the
+	  array only grows as far as the most subscriptions there ever were
+	  at once. Its memory is kept for reuse (memory_usage() reports it).
+
+	- Listeners may subscribe and unsubscribe while it's executing.
+	  Removed subscriptions are never called again, and new ones start
+	  with the next execution.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+#include "delegate_instrumentation.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	template<typename... Args>
+	class compact_delegate : delegate_base
+	{
+	private:
+		using callback_type = void(Args...);
+		using function_type = util::bound_function<callback_type>;
+
+		//a handle's slot is its entry's position
+		struct entry
+		{
+			//empty while this entry is a hole
+			function_type function;
+			union
+			{
+				//the handle owning this subscription, while used
+				delegate_handle* handle;
+				//the next hole, while this entry is one
+				uint32_t next_free;
+			};
+		};
+
+		std::pmr::vector<entry> m_entries;
+		uint32_t m_firstFree{ delegate_handle::no_slot };
+		size_t m_count{ 0 };
+
+		//how many executions of this delegate are currently running (more than one if a listener executes it again)
+		unsigned m_dispatchDepth{ 0 };
+		//whether subscriptions were added past the end while executing, see settle()
+		bool m_appendedWhileDispatching{ false };
+
+		//Counts an execution as running, however it ends.
+		struct dispatch_scope
+		{
+			compact_delegate* owner;
+
+			~dispatch_scope()
+			{
+				if (--owner->m_dispatchDepth == 0 && owner->m_appendedWhileDispatching)
+				{
+					owner->settle();
+				}
+			}
+		};
+
+		//Moves subscriptions made while executing (which had to go past the end) down into the holes,
+		//so a listener that keeps resubscribing doesn't grow the array forever.
+		void settle()
+		{
+			m_appendedWhileDispatching = false;
+			size_t kept{ 0 };
+			for (size_t i{ 0 }; i < m_entries.size(); ++i)
+			{
+				if (m_entries[i].function)
+				{
+					if (kept != i)
+					{
+						m_entries[kept] = m_entries[i];
+						notify_handle_placed(*m_entries[kept].handle, static_cast<uint32_t>(kept));
+					}
+					++kept;
+				}
+			}
+			m_entries.resize(kept);
+			m_firstFree = delegate_handle::no_slot;
+		}
+
+		//see delegate_instrumentation.hpp. Takes no space unless YADI_INSTRUMENTATION is on.
+		YADI_NO_UNIQUE_ADDRESS instrumentation::delegate_record m_stats;
+
+		delegate_handle add_callback(function_type fn)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				return handle;
+			}
+
+			//holes are only filled between executions, so an execution never calls subscriptions made during it
+			uint32_t index{ m_firstFree };
+			if (index == delegate_handle::no_slot || m_dispatchDepth != 0)
+			{
+				index = static_cast<uint32_t>(m_entries.size());
+				m_entries.push_back(entry{ fn, { &handle } });
+				m_appendedWhileDispatching = m_dispatchDepth != 0;
+			}
+			else
+			{
+				m_firstFree = m_entries[index].next_free;
+				m_entries[index].function = fn;
+				m_entries[index].handle = &handle;
+			}
+
+			++m_count;
+			notify_handle_placed(handle, index);
+			return handle;
+		}
+
+		void remove(uint32_t index)
+		{
+			entry& item{ m_entries[index] };
+			item.function = function_type{};
+			item.next_free = m_firstFree;
+			m_firstFree = index;
+			--m_count;
+		}
+
+		//see delegate_base::unsubscribe_batch. Each removal is already constant time,
+		//so this just skips the virtual call per handle.
+		void unsubscribe_batch(delegate_handle* const* handles, size_t count) override
+		{
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				compact_delegate::unsubscribe(*handles[i]);
+			}
+		}
+
+	public:
+		compact_delegate() = default;
+
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate the subscription array from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the delegate.
+		*/
+		explicit compact_delegate(std::pmr::memory_resource* resource)
+			: m_entries{ resource }
+		{
+		}
+
+		compact_delegate(compact_delegate const&) = delete;
+		compact_delegate& operator=(compact_delegate const&) = delete;
+
+		//handles that outlive the delegate are detached, rather than left pointing at it
+		~compact_delegate()
+		{
+			clear_all_subscriptions();
+		}
+
+		/*
+		* Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->Fn(Args...).
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T* instance)
+		{
+			return add_callback(function_type::template bind<Fn>(instance));
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T& instance)
+		{
+			return subscribe<Fn>(&instance);
+		}
+
+		//Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate.
+		template<auto Fn>
+		delegate_handle subscribe()
+		{
+			return add_callback(function_type::template bind<Fn>());
+		}
+
+		//A member function pointer and its instance take up more than an entry has room for.
+		template<typename T>
+		delegate_handle subscribe(void(T::*)(Args...), T*)
+		{
+			static_assert(sizeof(T) == 0, "yadi::compact_delegate: pass the member function as a template argument instead, subscribe<&T::fn>(instance).");
+			return {};
+		}
+
+		/*
+		* Given a function pointer, or a lambda capturing at most one pointer or reference, subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done fn(Args...).
+		* Subscribing a null function pointer does nothing, and returns an empty handle.
+		*
+		* Params:
+		* 	- fn
+		*		The function to call. It must be trivially copyable, and no bigger than a pointer.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename F>
+			requires std::is_invocable_v<F const&, Args...>
+		delegate_handle subscribe(F fn)
+		{
+			static_assert(function_type::template fits_small<F>,
+				"yadi::compact_delegate: listeners must fit in a pointer. Capture one pointer or reference at most, or use yadi::delegate_fast.");
+			return add_callback(function_type::bind_small(fn));
+		}
+
+		/*
+		* Given a delegate_handle (representing a valid subscription),
+		* remove the subscription and deactivate the handle. If the
+		* handle doesn't belong to this delegate, do nothing.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*/
+		void unsubscribe(delegate_handle& handle) override
+		{
+			if (!owns_handle(handle))
+			{
+				return;
+			}
+
+			remove(handle_position(handle));
+			notify_handle_unsubscribed(handle);
+		}
+
+		//Handles from this delegate carry their entry's position with them, so this is constant time.
+		void move_subscription(delegate_handle& old_handle, delegate_handle& new_handle) override
+		{
+			if (owns_handle(old_handle))
+			{
+				uint32_t const index{ handle_position(old_handle) };
+				m_entries[index].handle = &new_handle;
+				notify_handle_unsubscribed(old_handle);
+				notify_handle_placed(new_handle, index);
+			}
+		}
+
+		//Execute the underlying delegate, passing along the appropriate args.
+		//This calls all subscribed functions, in no particular order.
+		//Arguments are passed to every listener as they are, without being copied or moved.
+		void operator()(util::param_t<Args>... args)
+		{
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+			++m_dispatchDepth;
+			dispatch_scope const scope{ this };
+
+			//subscriptions made from here on go past the end
+			size_t const end{ m_entries.size() };
+			for (size_t i{ 0 }; i < end; ++i)
+			{
+				//copied out, since a listener subscribing may grow the array
+				function_type const function{ m_entries[i].function };
+				if (function)
+				{
+					function.call_shared(std::forward<util::param_t<Args>>(args)...);
+				}
+			}
+		}
+
+		//Returns the number of functions currently subscribed to this delegate.
+		size_t subscriber_count() const
+		{
+			return m_count;
+		}
+
+		//Returns the bytes this delegate has allocated, on top of sizeof(compact_delegate): its entries, holes included.
+		size_t memory_usage() const
+		{
+			return m_entries.capacity() * sizeof(entry);
+		}
+
+		//Pre-allocates room for the given number of subscriptions,
+		//so subscribing up to that many never has to grow the array.
+		void reserve(size_t count)
+		{
+			m_entries.reserve(count);
+		}
+
+		//Name this delegate in instrumentation reports. Does nothing unless YADI_INSTRUMENTATION is on.
+		void set_name(std::string name)
+		{
+			m_stats.set_name(std::move(name));
+		}
+
+		//Force-removes all subscribers from this delegate immediately, detaching their handles.
+		void clear_all_subscriptions()
+		{
+			for (size_t i{ 0 }; i < m_entries.size(); ++i)
+			{
+				if (m_entries[i].function)
+				{
+					notify_handle_unsubscribed(*m_entries[i].handle);
+					remove(static_cast<uint32_t>(i));
+				}
+			}
+		}
+	};
+}
+#endif
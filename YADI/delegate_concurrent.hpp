@@ -0,0 +1,424 @@
+#ifndef YADI_DELEGATE_CONCURRENT_H
+#define YADI_DELEGATE_CONCURRENT_H
+/************************************************************************
+ delegate_concurrent :
+	This contains the functionality for the yadi::concurrent_delegate class.
+	yadi::concurrent_delegate has the following restrictions and features:
+
+	- It is used like yadi::delegate, and hands out the same
+	  delegate_handle objects.
+
+	- Any thread may execute the delegate, subscribe, unsubscribe, or
+	  destroy/move a handle, all at the same time.
+
+	- Executing the delegate never takes a lock. It reads an immutable
+	  snapshot of the listeners. Changing the subscriptions builds a new
+	  snapshot and publishes it, so changes are relatively expensive:
+	  each one copies the listener list.
+
+	- Old snapshots are freed once no thread can still be executing them.
+	  Listeners may therefore safely unsubscribe (themselves or others)
+	  while the delegate is running. A thread that is already executing
+	  keeps seeing the snapshot it started with.
+
+	- A given delegate_handle must still only be used by one thread at a
+	  time. Destroying the delegate detaches its handles, so they may
+	  outlive it, but not race with its destruction.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	template<typename... Args>
+	class concurrent_delegate : delegate_base
+	{
+	private:
+		using callback_type = void(Args...);
+
+		struct entry
+		{
+			delegate_handle* handle;
+			util::inplace_function<callback_type> callback;
+		};
+
+		//never modified after being published
+		using snapshot = std::pmr::vector<entry>;
+
+		struct retired_snapshot
+		{
+			std::unique_ptr<snapshot> listeners;
+			//which reader counters have been seen empty since this was retired
+			bool drained[2];
+		};
+
+		//The listeners that executing threads should use. nullptr means nobody is subscribed.
+		std::atomic<snapshot*> m_current{ nullptr };
+
+		//Executing threads register themselves under the current epoch (by parity).
+		//Each published snapshot bumps the epoch. A thread that may still be reading the old
+		//snapshot registered before that, under either parity, so the old snapshot is only
+		//freed once both counters have been seen empty since it was retired.
+		std::atomic<uint64_t> m_epoch{ 0 };
+		std::atomic<size_t> m_readers[2]{};
+
+		std::atomic<size_t> m_count{ 0 };
+
+		//Only serializes writers against each other. Never taken while executing.
+		std::mutex m_writeLock;
+		std::pmr::vector<retired_snapshot> m_retired;
+
+		//only ever used with m_writeLock held, so it doesn't need to be thread-safe itself
+		std::pmr::memory_resource* m_resource;
+
+		//The following expect m_writeLock to be held.
+
+		snapshot const& current_listeners() const
+		{
+			static snapshot const empty;
+			snapshot const* current{ m_current.load(std::memory_order_relaxed) };
+			return current ? *current : empty;
+		}
+
+		void publish(std::unique_ptr<snapshot> next)
+		{
+			m_count.store(next->size(), std::memory_order_relaxed);
+			snapshot* old{ m_current.exchange(next->empty() ? nullptr : next.get(), std::memory_order_acq_rel) };
+			if (!next->empty())
+			{
+				next.release();
+			}
+
+			//threads registering from here on see the new snapshot
+			m_epoch.fetch_add(1, std::memory_order_seq_cst);
+			if (old)
+			{
+				m_retired.push_back(retired_snapshot{ std::unique_ptr<snapshot>{ old }, { false, false } });
+			}
+			reclaim();
+		}
+
+		//free every retired snapshot nobody can be reading anymore
+		void reclaim()
+		{
+			//a counter seen empty now can't hold anyone registered before any of these were retired
+			bool const empty[2]{ m_readers[0].load(std::memory_order_seq_cst) == 0, m_readers[1].load(std::memory_order_seq_cst) == 0 };
+			auto item{ m_retired.begin() };
+			while (item != m_retired.end())
+			{
+				item->drained[0] = item->drained[0] || empty[0];
+				item->drained[1] = item->drained[1] || empty[1];
+				if (item->drained[0] && item->drained[1])
+				{
+					item = m_retired.erase(item);
+				}
+				else
+				{
+					++item;
+				}
+			}
+		}
+
+		delegate_handle add_callback(util::inplace_function<callback_type>&& fn)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				//nothing to call
+				return handle;
+			}
+			//unlocked before returning, since moving the handle out (without NRVO) locks again in move_subscription
+			{
+				std::lock_guard<std::mutex> lock{ m_writeLock };
+
+				auto next{ std::make_unique<snapshot>(m_resource) };
+				next->reserve(current_listeners().size() + 1);
+				*next = current_listeners();
+				next->push_back(entry{ &handle, std::move(fn) });
+				publish(std::move(next));
+
+				notify_handle_subscribed(handle);
+			}
+			return handle;
+		}
+
+		//see delegate_base::unsubscribe_batch. Publishes one snapshot for the whole batch.
+		void unsubscribe_batch(delegate_handle* const* handles, size_t count) override
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			snapshot const& listeners{ current_listeners() };
+			auto next{ std::make_unique<snapshot>(m_resource) };
+			next->reserve(listeners.size());
+			for (auto const& item : listeners)
+			{
+				if (std::binary_search(handles, handles + count, item.handle, std::less<>{}))
+				{
+					notify_handle_unsubscribed(*item.handle);
+				}
+				else
+				{
+					next->push_back(item);
+				}
+			}
+
+			if (next->size() != listeners.size())
+			{
+				publish(std::move(next));
+			}
+		}
+
+	public:
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate the listener lists from (see subscription_pool in delegate_pool.hpp).
+		*		This delegate only uses it under its own lock, so it needn't be thread-safe unless other delegates share it.
+		*		It must outlive the delegate.
+		*/
+		explicit concurrent_delegate(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_retired{ resource }, m_resource{ resource }
+		{
+		}
+
+		concurrent_delegate(concurrent_delegate const&) = delete;
+		concurrent_delegate& operator=(concurrent_delegate const&) = delete;
+
+		//Nothing may be executing this delegate when it is destroyed.
+		//Handles that outlive it are detached, rather than left pointing at it.
+		~concurrent_delegate()
+		{
+			clear_all_subscriptions();
+			delete m_current.load(std::memory_order_acquire);
+		}
+
+		/*
+		* Given a member function pointer (&Coffee::Brew) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The member function to subscribe. Its signature must match the one provided by the delegate.
+		*	- instance
+		*		A pointer to the object to call the function on. It must be valid to call the given member function on it.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename T>
+		delegate_handle subscribe(void(T::* fn)(Args...), T* instance)
+		{
+			return add_callback(util::attach(fn, instance));
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<typename T>
+		delegate_handle subscribe(void(T::* fn)(Args...), T& instance)
+		{
+			return subscribe(fn, &instance);
+		}
+
+		/*
+		* Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->Fn(Args...).
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T* instance)
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), T*, Args...>, "yadi::concurrent_delegate: Fn can't be called on T with this delegate's arguments.");
+			return add_callback(util::member_caller<Fn, T>{ instance });
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T& instance)
+		{
+			return subscribe<Fn>(&instance);
+		}
+
+		//Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate.
+		template<auto Fn>
+		delegate_handle subscribe()
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), Args...>, "yadi::concurrent_delegate: Fn can't be called with this delegate's arguments.");
+			return add_callback(util::free_caller<Fn>{});
+		}
+
+		/*
+		* Given any function object (lambda, function pointer, functor, etc), subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done fn(Args...).
+		* The function may be called from any thread that executes the delegate.
+		*
+		* Params:
+		* 	- fn
+		*		The function to call. This can be any type that will construct a valid util::inplace_function.
+		*		Subscribing an empty function does nothing, and returns an empty handle.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe(util::inplace_function<callback_type> fn)
+		{
+			return add_callback(std::move(fn));
+		}
+
+		/*
+		* Given a delegate_handle (representing a valid subscription),
+		* remove the subscription and deactivate the handle. If the
+		* handle doesn't belong to this delegate, do nothing.
+		*
+		* Threads that are executing the delegate right now may still call the
+		* removed listener once more. Threads that start executing afterwards won't.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*/
+		void unsubscribe(delegate_handle& handle) override
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			snapshot const& listeners{ current_listeners() };
+			auto next{ std::make_unique<snapshot>(m_resource) };
+			next->reserve(listeners.size());
+			for (auto const& item : listeners)
+			{
+				if (item.handle != &handle)
+				{
+					next->push_back(item);
+				}
+			}
+
+			if (next->size() != listeners.size())
+			{
+				publish(std::move(next));
+				notify_handle_unsubscribed(handle);
+			}
+		}
+
+		/*
+		* Transfers ownership of a delegate subscription from one handle to another.
+		* This assumes that the old handle is connected to this delegate already.
+		* If it isn't, calling this has no effect.
+		*
+		* Params:
+		*	- old_handle
+		*		The handle to move the subscription away from. This handle should be subscribed to this delegate already.
+		*	- new_handle
+		*		The handle to move the subscription to. If it already owns another subscription, that one will be removed.
+		*/
+		void move_subscription(delegate_handle& old_handle, delegate_handle& new_handle) override
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			snapshot const& listeners{ current_listeners() };
+			for (size_t i{ 0 }; i < listeners.size(); ++i)
+			{
+				if (listeners[i].handle == &old_handle)
+				{
+					auto next{ std::make_unique<snapshot>(listeners, m_resource) };
+					(*next)[i].handle = &new_handle;
+					publish(std::move(next));
+
+					notify_handle_unsubscribed(old_handle);
+					notify_handle_subscribed(new_handle);
+					return;
+				}
+			}
+		}
+
+		//Execute the underlying delegate, passing along the appropriate args.
+		//This calls all subscribed functions, and never blocks.
+		//Arguments are passed to every listener as they are, without being copied or moved.
+		void operator()(util::param_t<Args>... args)
+		{
+			//register as a reader of the current epoch. if the epoch moved on in the meantime,
+			//a writer may not have seen us, so try again.
+			uint64_t epoch{ m_epoch.load(std::memory_order_seq_cst) };
+			while (true)
+			{
+				m_readers[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
+				uint64_t const confirmed{ m_epoch.load(std::memory_order_seq_cst) };
+				if (confirmed == epoch)
+				{
+					break;
+				}
+				m_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+				epoch = confirmed;
+			}
+
+			if (snapshot const* listeners{ m_current.load(std::memory_order_acquire) })
+			{
+				for (auto const& item : *listeners)
+				{
+					item.callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+				}
+			}
+
+			m_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+		}
+
+		//Returns the number of functions currently subscribed to this delegate.
+		size_t subscriber_count() const
+		{
+			return m_count.load(std::memory_order_relaxed);
+		}
+
+		//Returns the bytes this delegate has allocated, on top of sizeof(concurrent_delegate):
+		//the current listener list, and any old ones still waiting for readers to finish with them.
+		size_t memory_usage()
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			size_t total{ m_retired.capacity() * sizeof(retired_snapshot) };
+			if (snapshot const* current{ m_current.load(std::memory_order_relaxed) })
+			{
+				total += sizeof(snapshot) + current->capacity() * sizeof(entry);
+			}
+			for (auto const& item : m_retired)
+			{
+				total += sizeof(snapshot) + item.listeners->capacity() * sizeof(entry);
+			}
+			return total;
+		}
+
+		/*
+		* Force-removes all subscribers from this delegate immediately.
+		* This writes to every handle, so it must not race with those handles
+		* being moved or destroyed on other threads.
+		*/
+		void clear_all_subscriptions()
+		{
+			std::lock_guard<std::mutex> lock{ m_writeLock };
+
+			for (auto const& item : current_listeners())
+			{
+				notify_handle_unsubscribed(*item.handle);
+			}
+			publish(std::make_unique<snapshot>(m_resource));
+		}
+	};
+}
+#endif
@@ -6,18 +6,42 @@
 
    You probably don't want to directly include this, instead you likely want one of the following
    public interfaces:
-	 delegate.hpp               - standard, simple, event-like multicast delegate
-	 delegate_fast.hpp          - high-performance delegate with fewer subscription options
-	 delegate_interruptible.hpp - delegate that can be interrupted by one of the callbacks
+	 delegate.hpp                 - standard, simple, event-like multicast delegate
+	 delegate_fast.hpp            - high-performance delegate with fewer subscription options
+	 delegate_interruptible.hpp   - delegate that can be interrupted by one of the callbacks
+	 delegate_concurrent.hpp      - delegate that can be used from many threads at once
+	 delegate_parallel.hpp        - thread pool that delegate_fast can spread its listeners across
+	 delegate_queue.hpp           - delegate that can also record events and deliver them later, in bulk
+	 delegate_group.hpp           - owns many subscriptions, across delegates, and removes them in bulk
+	 delegate_pool.hpp            - memory pool that delegates can allocate their subscriptions from
+	 delegate_instrumentation.hpp - optional timing of delegates and listeners, and reports on them
+	 delegate_static.hpp          - delegate whose listeners are fixed at compile time, and fully inlined
+	 delegate_bus.hpp             - routes events to listeners by the event's type
+	 delegate_channel.hpp         - delegate that other threads can post events to, without locking
+	 delegate_intrusive.hpp       - delegate whose handles hold their own subscriptions, linked together
+	 delegate_keyed.hpp           - delegate that only calls the listeners of the key it's executed with
+	 delegate_coalescing.hpp      - delegate that folds repeated raises into one call, delivered at a flush
+	 delegate_affinity.hpp        - delegate whose listeners can run on a given thread, through its executor_queue
+	 delegate_compact.hpp         - delegate storing each subscription in 24 bytes, for huge subscriber counts
+	 yadi.cppm                    - all of the above as a C++20 module, for import yadi;
 
 ***************************************************************************************************/
 
 #include "delegate_util.hpp"
 
-namespace yadi
+#include <cstdint>
+
+//The signatures most programs have delegates of, to explicitly instantiate them all at once:
+//	YADI_COMMON_SIGNATURES(YADI_EXTERN_DELEGATE);        in a header everyone includes
+//	YADI_COMMON_SIGNATURES(YADI_INSTANTIATE_DELEGATE);   in exactly one source file
+//See YADI_EXTERN_DELEGATE in delegate.hpp. Works the same with the delegate_fast ones.
+#define YADI_COMMON_SIGNATURES(X) X(); X(int); X(float); X(bool)
+
+YADI_EXPORT namespace yadi
 {
 	//Forward declarations
 	class delegate_handle;
+	class subscription_group;
 
 	//we define a base delegate class and derive from it.
 	//this lets us avoid making delegate_handle a template class,
@@ -50,6 +74,38 @@ namespace yadi
 		//notify the handle that its unsubscription was successful
 		void notify_handle_unsubscribed(delegate_handle& handle);
 
+		/*
+		* Notify the handle that its subscription was successful, for delegates that
+		* find subscriptions by slot rather than by the handle's address.
+		*
+		* A handle subscribed this way can be moved without telling the delegate:
+		* the slot and generation travel with it, and move_subscription is never called.
+		* Since the delegate never learns where its handles are, it can't detach them when it
+		* goes. Such delegates hand handles to a handle_anchor instead, which outlives them.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*	- slot
+		*		Where the delegate keeps this subscription. Any value but no_slot.
+		*	- generation
+		*		Lets the delegate tell this subscription apart from later ones that reuse the slot.
+		*/
+		void notify_handle_subscribed(delegate_handle& handle, uint32_t slot, uint32_t generation);
+
+		//Same as notify_handle_subscribed(handle), and keeps a number in the handle for the delegate,
+		//such as where its subscription is. The handle still calls move_subscription when it moves.
+		void notify_handle_placed(delegate_handle& handle, uint32_t position);
+
+		//returns true if the handle is currently subscribed to this delegate
+		bool owns_handle(delegate_handle const& handle) const;
+
+		//the slot and generation given to notify_handle_subscribed
+		static uint32_t handle_slot(delegate_handle const& handle);
+		static uint32_t handle_generation(delegate_handle const& handle);
+		//the position given to notify_handle_placed
+		static uint32_t handle_position(delegate_handle const& handle);
+
 		/*
 		* Given two delegate handles, move a subscription from one
 		* to the other. This does NOT change the underlying function, only
@@ -66,9 +122,31 @@ namespace yadi
 		*		subscribed to something else first.
 		*/
 		virtual void move_subscription(delegate_handle& old_handle, delegate_handle& new_handle) = 0;
+
+		/*
+		* Remove many subscriptions at once, deactivating their handles. Handles that
+		* don't belong to this delegate are ignored. Delegates override this to remove
+		* everything in one go, rather than one unsubscribe call per handle.
+		*
+		* Params:
+		*	- handles
+		*		The handles to unsubscribe, with no duplicates. They are sorted by address (std::less),
+		*		or by slot and then generation if they have one (see handle_anchor).
+		*	- count
+		*		How many handles there are.
+		*/
+		virtual void unsubscribe_batch(delegate_handle* const* handles, size_t count)
+		{
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				unsubscribe(*handles[i]);
+			}
+		}
 	private:
 		//needed to give access to move_subscription
 		friend class delegate_handle;
+		//needed to give access to unsubscribe_batch
+		friend class subscription_group;
 	};
 
 
@@ -85,7 +163,7 @@ namespace yadi
 		{
 			if (m_boundDelegate)
 			{
-				m_boundDelegate->move_subscription(other, *this);
+				take_subscription(other);
 			}
 		}
 
@@ -100,7 +178,7 @@ namespace yadi
 			}
 			if (other.m_boundDelegate)
 			{
-				other.m_boundDelegate->move_subscription(other, *this);
+				take_subscription(other);
 			}
 
 			return *this;
@@ -119,24 +197,185 @@ namespace yadi
 		{
 			unsubscribe();
 		}
+
+		//used by delegates that track subscriptions by slot, see delegate_base::notify_handle_subscribed
+		static constexpr uint32_t no_slot{ UINT32_MAX };
+
 	private:
 		delegate_base* m_boundDelegate{ nullptr };
 
+		//only set by delegates that track subscriptions by slot instead of by handle address
+		uint32_t m_slot{ no_slot };
+		//doubles as the position given to notify_handle_placed, for handles without a slot
+		uint32_t m_generation{ 0 };
+
+		//expects other to be subscribed, and this not to be
+		void take_subscription(delegate_handle& other)
+		{
+			if (other.m_slot != no_slot)
+			{
+				//the delegate doesn't know or care where we live, so this is just a copy
+				m_boundDelegate = other.m_boundDelegate;
+				m_slot = other.m_slot;
+				m_generation = other.m_generation;
+				other.m_boundDelegate = nullptr;
+				other.m_slot = no_slot;
+			}
+			else
+			{
+				other.m_boundDelegate->move_subscription(other, *this);
+			}
+		}
+
 		friend class delegate_base;
+		friend class subscription_group;
+	};
+
+
+	/*
+	* What the handles of a slot-based delegate (see delegate_base::notify_handle_subscribed) are bound to,
+	* instead of the delegate itself. The delegate never learns where its handles are, so when it's cleared,
+	* it only bumps its slots' generations, and stale handles find out when they next unsubscribe. When it's
+	* destroyed, it leaves its anchor behind until the last handle lets go, so handles may outlive it.
+	*
+	* Owner must provide release_slot(slot, generation), which removes the subscription if it's still
+	* there, and may provide release_batch(handles, count) to remove many at once, the handles sorted
+	* by slot then generation. The anchor is allocated with new, since it outlives the delegate's memory resource.
+	*/
+	template<typename Owner>
+	class handle_anchor final : public delegate_base
+	{
+	public:
+		explicit handle_anchor(Owner* owner)
+			: m_owner{ owner }
+		{
+		}
+
+		//hands a subscription to handle
+		void attach(delegate_handle& handle, uint32_t slot, uint32_t generation)
+		{
+			notify_handle_subscribed(handle, slot, generation);
+			++m_handles;
+		}
+
+		//returns true if the handle holds a subscription from this anchor's delegate (cleared ones included)
+		bool holds(delegate_handle const& handle) const
+		{
+			return owns_handle(handle);
+		}
+
+		//Called by the owner's destructor. Frees the anchor now, or once the last handle lets go.
+		void orphan()
+		{
+			m_owner = nullptr;
+			release_if_unused();
+		}
+
+		void unsubscribe(delegate_handle& handle) override
+		{
+			if (!owns_handle(handle))
+			{
+				return;
+			}
+			if (m_owner)
+			{
+				m_owner->release_slot(handle_slot(handle), handle_generation(handle));
+			}
+			notify_handle_unsubscribed(handle);
+			--m_handles;
+			release_if_unused();
+		}
+
+		//slot handles move without calling this
+		void move_subscription(delegate_handle&, delegate_handle&) override
+		{
+		}
+
+	private:
+		Owner* m_owner;
+		//handles bound to this anchor, including ones whose subscription was cleared
+		size_t m_handles{ 0 };
+
+		void release_if_unused()
+		{
+			if (!m_owner && m_handles == 0)
+			{
+				delete this;
+			}
+		}
+
+		//see delegate_base::unsubscribe_batch. subscription_group sorts slot handles by slot, then generation.
+		void unsubscribe_batch(delegate_handle* const* handles, size_t count) override
+		{
+			if (m_owner)
+			{
+				if constexpr (requires { m_owner->release_batch(handles, count); })
+				{
+					m_owner->release_batch(handles, count);
+				}
+				else
+				{
+					for (size_t i{ 0 }; i < count; ++i)
+					{
+						m_owner->release_slot(handle_slot(*handles[i]), handle_generation(*handles[i]));
+					}
+				}
+			}
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				notify_handle_unsubscribed(*handles[i]);
+			}
+			m_handles -= count;
+			release_if_unused();
+		}
 	};
 
 
 
 	//implementation below
 
-	void delegate_base::notify_handle_subscribed(delegate_handle& handle)
+	inline void delegate_base::notify_handle_subscribed(delegate_handle& handle)
 	{
 		handle.m_boundDelegate = this;
 	}
 
-	void delegate_base::notify_handle_unsubscribed(delegate_handle& handle)
+	inline void delegate_base::notify_handle_unsubscribed(delegate_handle& handle)
 	{
 		handle.m_boundDelegate = nullptr;
+		handle.m_slot = delegate_handle::no_slot;
+	}
+
+	inline void delegate_base::notify_handle_subscribed(delegate_handle& handle, uint32_t slot, uint32_t generation)
+	{
+		handle.m_boundDelegate = this;
+		handle.m_slot = slot;
+		handle.m_generation = generation;
+	}
+
+	inline void delegate_base::notify_handle_placed(delegate_handle& handle, uint32_t position)
+	{
+		handle.m_boundDelegate = this;
+		handle.m_generation = position;
+	}
+
+	inline bool delegate_base::owns_handle(delegate_handle const& handle) const
+	{
+		return handle.m_boundDelegate == this;
+	}
+
+	inline uint32_t delegate_base::handle_slot(delegate_handle const& handle)
+	{
+		return handle.m_slot;
+	}
+
+	inline uint32_t delegate_base::handle_generation(delegate_handle const& handle)
+	{
+		return handle.m_generation;
+	}
+
+	inline uint32_t delegate_base::handle_position(delegate_handle const& handle)
+	{
+		return handle.m_generation;
 	}
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,477 @@
+#ifndef YADI_DELEGATE_FAST_H
+#define YADI_DELEGATE_FAST_H
+/************************************************************************
+ delegate_fast :
+	This contains the functionality for the yadi::delegate_fast class.
+	yadi::delegate_fast has the following restrictions and features:
+
+	- It is used exactly like yadi::delegate, and hands out the same
+	  delegate_handle objects. Switching between the two requires no
+	  changes to user code.
+
+	- Callbacks are kept in one contiguous array, so executing the
+	  delegate is a straight walk over memory instead of a tree walk.
+
+	- Handles remember where their subscription lives, so unsubscribing
+	  is constant time, and moving a handle (for example, when a
+	  std::vector of them grows) is a plain copy that never calls the
+	  delegate at all.
+
+	- Clearing the delegate leaves its handles harmless: they see their
+	  subscription is gone when they next unsubscribe. Handles may also
+	  outlive the delegate (see handle_anchor in delegate_core.hpp).
+
+	- Removing a subscription swaps the last callback into its place.
+	  This means the order listeners are called in is NOT stable.
+	  If you need ordering guarantees, this is the wrong delegate.
+
+	- Listeners must not subscribe or unsubscribe from this delegate
+	  while it is executing.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+#include "delegate_instrumentation.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	template<typename... Args>
+	class delegate_fast : delegate_base
+	{
+	private:
+		using callback_type = void(Args...);
+
+		//Subscriptions to functions known at compile time (see subscribe<Fn>) only need an
+		//instance pointer and a thunk, so they are kept in their own, tighter array.
+		//Everything else goes in m_callbacks.
+		//These two arrays are the only thing touched while executing, so they're kept on their own.
+		//m_boundSlots[i] is the slot that owns m_bound[i], and likewise for m_callbackSlots and m_callbacks.
+		std::pmr::vector<util::bound_function<callback_type>> m_bound;
+		std::pmr::vector<uint32_t> m_boundSlots;
+		std::pmr::vector<util::inplace_function<callback_type>> m_callbacks;
+		std::pmr::vector<uint32_t> m_callbackSlots;
+
+		//Handles remember their slot, so finding a subscription is an array lookup.
+		//Freed slots are reused, with a new generation so stale handles can't touch the new owner.
+		struct slot
+		{
+			uint32_t generation;
+			//the position in m_bound/m_callbacks while used, or the next free slot while not
+			uint32_t index;
+			bool bound;
+			bool used;
+		};
+
+		std::pmr::vector<slot> m_slots;
+		uint32_t m_freeSlot{ delegate_handle::no_slot };
+
+		//what our handles are bound to, made on the first subscription
+		handle_anchor<delegate_fast>* m_anchor{ nullptr };
+		friend class handle_anchor<delegate_fast>;
+
+		//see delegate_instrumentation.hpp. Takes no space unless YADI_INSTRUMENTATION is on.
+		YADI_NO_UNIQUE_ADDRESS instrumentation::delegate_record m_stats;
+
+		uint32_t acquire_slot(uint32_t index, bool bound)
+		{
+			uint32_t id{ m_freeSlot };
+			if (id == delegate_handle::no_slot)
+			{
+				id = static_cast<uint32_t>(m_slots.size());
+				m_slots.push_back(slot{ 0, 0, false, false });
+			}
+			else
+			{
+				m_freeSlot = m_slots[id].index;
+			}
+
+			m_slots[id].index = index;
+			m_slots[id].bound = bound;
+			m_slots[id].used = true;
+			return id;
+		}
+
+		void free_slot(uint32_t id)
+		{
+			slot& item{ m_slots[id] };
+			++item.generation;
+			item.used = false;
+			item.index = m_freeSlot;
+			m_freeSlot = id;
+		}
+
+		handle_anchor<delegate_fast>& anchor()
+		{
+			if (!m_anchor)
+			{
+				m_anchor = new handle_anchor<delegate_fast>{ this };
+			}
+			return *m_anchor;
+		}
+
+		delegate_handle add_callback(util::inplace_function<callback_type>&& fn)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				return handle;
+			}
+			uint32_t const id{ acquire_slot(static_cast<uint32_t>(m_callbacks.size()), false) };
+			m_callbacks.push_back(std::move(fn));
+			m_callbackSlots.push_back(id);
+			anchor().attach(handle, id, m_slots[id].generation);
+			return handle;
+		}
+
+		delegate_handle add_callback(util::bound_function<callback_type> fn)
+		{
+			delegate_handle handle;
+			uint32_t const id{ acquire_slot(static_cast<uint32_t>(m_bound.size()), true) };
+			m_bound.push_back(fn);
+			m_boundSlots.push_back(id);
+			anchor().attach(handle, id, m_slots[id].generation);
+			return handle;
+		}
+
+		//see handle_anchor. A handle whose subscription was cleared may name a slot someone else has now.
+		void release_slot(uint32_t id, uint32_t generation)
+		{
+			if (id < m_slots.size() && m_slots[id].used && m_slots[id].generation == generation)
+			{
+				slot const where{ m_slots[id] };
+				free_slot(id);
+				if (where.bound)
+				{
+					swap_remove(m_bound, m_boundSlots, where.index);
+				}
+				else
+				{
+					swap_remove(m_callbacks, m_callbackSlots, where.index);
+				}
+			}
+		}
+
+		//swap the last callback into the freed spot so the array stays dense
+		template<typename Callback>
+		void swap_remove(std::pmr::vector<Callback>& callbacks, std::pmr::vector<uint32_t>& slots, uint32_t index)
+		{
+			size_t const last{ callbacks.size() - 1 };
+			if (index != last)
+			{
+				callbacks[index] = std::move(callbacks[last]);
+				slots[index] = slots[last];
+				m_slots[slots[index]].index = index;
+			}
+			callbacks.pop_back();
+			slots.pop_back();
+		}
+
+	public:
+		delegate_fast() = default;
+
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate the subscription arrays from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the delegate.
+		*/
+		explicit delegate_fast(std::pmr::memory_resource* resource)
+			: m_bound{ resource }, m_boundSlots{ resource }, m_callbacks{ resource }, m_callbackSlots{ resource }, m_slots{ resource }
+		{
+		}
+
+		delegate_fast(delegate_fast const&) = delete;
+		delegate_fast& operator=(delegate_fast const&) = delete;
+
+		//handles that outlive the delegate keep its anchor alive, rather than pointing at the delegate
+		~delegate_fast()
+		{
+			if (m_anchor)
+			{
+				m_anchor->orphan();
+			}
+		}
+
+		/*
+		* Given a member function pointer (&Coffee::Brew) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The member function to subscribe. Its signature must match the one provided by the delegate.
+		*	- instance
+		*		A pointer to the object to call the function on. It must be valid to call the given member function on it.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename T>
+		delegate_handle subscribe(void(T::* fn)(Args...), T* instance)
+		{
+			return add_callback(util::attach(fn, instance));
+		}
+
+		/*
+		* Given a member function pointer (&Coffee::Brew) and an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance.fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The member function to subscribe. Its signature must match the one provided by the delegate.
+		*	- instance
+		*		An lvalue reference of the object to call the function on. It must be valid to call the given member function on it.
+				You must ensure that the delegate_handle returned does not outlive the object.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename T>
+		delegate_handle subscribe(void(T::* fn)(Args...), T& instance)
+		{
+			return subscribe(fn, &instance);
+		}
+
+		/*
+		* Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->Fn(Args...).
+		*
+		* This is the cheapest kind of subscription there is. Only the instance and a generated thunk are stored
+		* (two pointers), and the call to Fn is inlined into the thunk.
+		*
+		* Template params:
+		*	- Fn
+		*		The member function to subscribe. It must be callable on T with the delegate's arguments.
+		*
+		* Params:
+		*	- instance
+		*		A pointer to the object to call the function on.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T* instance)
+		{
+			return add_callback(util::bound_function<callback_type>::template bind<Fn>(instance));
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T& instance)
+		{
+			return subscribe<Fn>(&instance);
+		}
+
+		/*
+		* Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done Fn(Args...).
+		* Like the member function version, this only stores two pointers.
+		*
+		* Template params:
+		*	- Fn
+		*		The function to subscribe. It must be callable with the delegate's arguments.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn>
+		delegate_handle subscribe()
+		{
+			return add_callback(util::bound_function<callback_type>::template bind<Fn>());
+		}
+
+		/*
+		* Given any function object (lambda, function pointer, functor, etc), subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The function to call. This can be any type that will construct a valid util::inplace_function.
+		*		That includes function pointers, lambdas, and other functors, as long as their captures fit
+		*		in YADI_INPLACE_FUNCTION_CAPACITY bytes. Subscribing never allocates memory for the function itself.
+		*		An empty function isn't subscribed.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription (or an empty one, if fn was empty).
+		*	When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe(util::inplace_function<callback_type> fn)
+		{
+			return add_callback(std::move(fn));
+		}
+
+		/*
+		* Given a delegate_handle (representing a valid subscription),
+		* remove the subscription and deactivate the handle. If the
+		* handle doesn't belong to this delegate, do nothing.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*/
+		void unsubscribe(delegate_handle& handle) override
+		{
+			if (m_anchor)
+			{
+				m_anchor->unsubscribe(handle);
+			}
+		}
+
+		//Handles from this delegate carry their slot with them, and move without calling this.
+		void move_subscription(delegate_handle&, delegate_handle&) override
+		{
+		}
+
+		//Execute the underlying delegate, passing along the appropriate args.
+		//This calls all subscribed functions, in no particular order.
+		//Arguments are passed to every listener as they are, without being copied or moved.
+		void operator()(util::param_t<Args>... args)
+		{
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+			for (auto& callback : m_bound)
+			{
+				callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+			}
+			for (auto& callback : m_callbacks)
+			{
+				callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+			}
+		}
+
+		//dispatch_parallel runs serially below this many listeners. Handing work to other threads
+		//costs more than calling a few hundred cheap listeners.
+		static constexpr size_t parallel_min_listeners{ 512 };
+		//dispatch_parallel never hands a thread fewer listeners than this at once.
+		static constexpr size_t parallel_min_chunk{ 64 };
+
+		/*
+		* Execute the underlying delegate like operator(), but spread the listeners
+		* across the threads of an executor (such as yadi::worker_pool, see delegate_parallel.hpp).
+		* Returns once every listener has been called.
+		*
+		* Small delegates (see parallel_min_listeners) are simply executed on this thread.
+		* Otherwise the listeners are split into chunks, a few per thread, so that threads
+		* which finish early can pick up the slack. Every listener is called exactly once.
+		*
+		* Listeners must be safe to call from any thread, and at the same time as each other.
+		* The arguments are shared between all threads, so listeners must not modify them.
+		*
+		* Params:
+		*	- executor
+		*		The thread pool to run on. See delegate_parallel.hpp for what it must provide.
+		*	- args
+		*		The arguments to pass to every listener.
+		*/
+		template<typename Executor>
+		void dispatch_parallel(Executor& executor, util::param_t<Args>... args)
+		{
+			size_t const total{ subscriber_count() };
+			size_t const threads{ executor.concurrency() };
+			if (threads <= 1 || total < parallel_min_listeners)
+			{
+				(*this)(std::forward<util::param_t<Args>>(args)...);
+				return;
+			}
+
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+
+			//aim for a few chunks per thread, so a thread that got slow listeners doesn't hold up the rest
+			constexpr size_t chunks_per_thread{ 4 };
+			size_t chunk{ total / (threads * chunks_per_thread) };
+			if (chunk < parallel_min_chunk)
+			{
+				chunk = parallel_min_chunk;
+			}
+			size_t const chunk_count{ (total + chunk - 1) / chunk };
+
+			executor.parallel_for(chunk_count, [this, chunk, total, &args...](size_t index)
+			{
+				size_t const begin{ index * chunk };
+				size_t const end{ begin + chunk < total ? begin + chunk : total };
+
+				//the listener index space is m_bound followed by m_callbacks
+				size_t const bound_count{ m_bound.size() };
+				for (size_t i{ begin }; i < end; ++i)
+				{
+					if (i < bound_count)
+					{
+						m_bound[i].call_shared(std::forward<util::param_t<Args>>(args)...);
+					}
+					else
+					{
+						m_callbacks[i - bound_count].call_shared(std::forward<util::param_t<Args>>(args)...);
+					}
+				}
+			});
+		}
+
+		//Returns the number of functions currently subscribed to this delegate.
+		size_t subscriber_count() const
+		{
+			return m_bound.size() + m_callbacks.size();
+		}
+
+		//Returns the bytes this delegate has allocated, on top of sizeof(delegate_fast): its arrays, spare capacity included.
+		size_t memory_usage() const
+		{
+			return m_bound.capacity() * sizeof(util::bound_function<callback_type>) + m_boundSlots.capacity() * sizeof(uint32_t)
+				+ m_callbacks.capacity() * sizeof(util::inplace_function<callback_type>) + m_callbackSlots.capacity() * sizeof(uint32_t)
+				+ m_slots.capacity() * sizeof(slot);
+		}
+
+		//Pre-allocates room for the given number of subscriptions,
+		//so subscribing up to that many never has to grow the arrays.
+		void reserve(size_t count)
+		{
+			m_bound.reserve(count);
+			m_boundSlots.reserve(count);
+			m_callbacks.reserve(count);
+			m_callbackSlots.reserve(count);
+			m_slots.reserve(count);
+		}
+
+		//Name this delegate in instrumentation reports. Does nothing unless YADI_INSTRUMENTATION is on.
+		void set_name(std::string name)
+		{
+			m_stats.set_name(std::move(name));
+		}
+
+		//Force-removes all subscribers from this delegate immediately.
+		//Their handles are left harmless, see handle_anchor.
+		void clear_all_subscriptions()
+		{
+			for (uint32_t id : m_boundSlots)
+			{
+				free_slot(id);
+			}
+			for (uint32_t id : m_callbackSlots)
+			{
+				free_slot(id);
+			}
+			m_bound.clear();
+			m_boundSlots.clear();
+			m_callbacks.clear();
+			m_callbackSlots.clear();
+		}
+	};
+}
+
+//Same as YADI_EXTERN_DELEGATE and YADI_INSTANTIATE_DELEGATE in delegate.hpp, for delegate_fast.
+#define YADI_EXTERN_DELEGATE_FAST(...) extern template class yadi::delegate_fast<__VA_ARGS__>
+#define YADI_INSTANTIATE_DELEGATE_FAST(...) template class yadi::delegate_fast<__VA_ARGS__>
+#endif
@@ -0,0 +1,182 @@
+#ifndef YADI_DELEGATE_GROUP_H
+#define YADI_DELEGATE_GROUP_H
+/************************************************************************
+ delegate_group :
+	This contains the functionality for the yadi::subscription_group class.
+	yadi::subscription_group has the following restrictions and features:
+
+	- It takes ownership of delegate_handles from any number of delegates,
+	  of any kind. Give an object one group instead of a handle member
+	  per subscription.
+
+	- Subscriptions are stored together, not scattered across your
+	  objects. A subscription to a delegate whose handles carry a slot
+	  (yadi::delegate, delegate_fast, keyed_delegate) is nothing but
+	  {delegate, slot, generation}, kept in one array. Adding it is a
+	  copy that never calls the delegate.
+
+	- Handles of the other delegates are tracked by their address, so
+	  they are kept in a few large blocks where they never move. Adding
+	  one costs the usual handle move.
+
+	- Destroying or clearing the group removes its subscriptions one
+	  delegate at a time: each delegate is asked once to drop all of the
+	  group's subscriptions, instead of once per handle.
+
+	- Whether a delegate may go before the group is up to the delegate,
+	  as with any handle.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	class subscription_group
+	{
+	private:
+		//handles with a slot, which move without their delegate knowing
+		std::vector<delegate_handle> m_slotted;
+		//everyone else, in a deque so they never move once added. Moving these costs their delegate a lookup.
+		std::deque<delegate_handle> m_tracked;
+
+		//unsubscribes the handles in [begin, end), which are sorted so each delegate's are next to each other
+		static void unsubscribe_runs(delegate_handle* const* begin, delegate_handle* const* end)
+		{
+			while (begin != end)
+			{
+				delegate_base* const owner{ (*begin)->m_boundDelegate };
+				delegate_handle* const* run{ begin + 1 };
+				while (run != end && (*run)->m_boundDelegate == owner)
+				{
+					++run;
+				}
+				owner->unsubscribe_batch(begin, static_cast<size_t>(run - begin));
+				begin = run;
+			}
+		}
+
+	public:
+		subscription_group() = default;
+
+		subscription_group(subscription_group const&) = delete;
+		subscription_group& operator=(subscription_group const&) = delete;
+
+		//moving a deque hands over its blocks, so the tracked handles themselves stay put
+		subscription_group(subscription_group&& other) noexcept = default;
+
+		subscription_group& operator=(subscription_group&& other) noexcept
+		{
+			if (this != &other)
+			{
+				clear();
+				m_slotted = std::move(other.m_slotted);
+				m_tracked = std::move(other.m_tracked);
+			}
+			return *this;
+		}
+
+		~subscription_group()
+		{
+			clear();
+		}
+
+		/*
+		* Take ownership of a subscription. It is removed when the group is destroyed or cleared.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription. Empty handles are ignored.
+		*/
+		void add(delegate_handle&& handle)
+		{
+			if (!handle.m_boundDelegate)
+			{
+				return;
+			}
+			if (handle.m_slot != delegate_handle::no_slot)
+			{
+				m_slotted.push_back(std::move(handle));
+			}
+			else
+			{
+				m_tracked.push_back(std::move(handle));
+			}
+		}
+
+		//Same as add(), so subscriptions can be written group += delegate.subscribe(...);
+		subscription_group& operator+=(delegate_handle&& handle)
+		{
+			add(std::move(handle));
+			return *this;
+		}
+
+		//Remove every subscription in the group, one pass per delegate.
+		void clear()
+		{
+			if (empty())
+			{
+				return;
+			}
+
+			std::vector<delegate_handle*> batch;
+			batch.reserve(m_slotted.size() + m_tracked.size());
+			std::less<> const before;
+
+			//slot handles stay bound to their delegate (or its anchor) even once it drops them
+			for (auto& handle : m_slotted)
+			{
+				batch.push_back(&handle);
+			}
+			//group by delegate, then by slot and generation, which is the order handle_anchor expects
+			std::sort(batch.begin(), batch.end(), [&before](delegate_handle const* a, delegate_handle const* b)
+			{
+				if (a->m_boundDelegate != b->m_boundDelegate)
+				{
+					return before(a->m_boundDelegate, b->m_boundDelegate);
+				}
+				return a->m_slot != b->m_slot ? a->m_slot < b->m_slot : a->m_generation < b->m_generation;
+			});
+			size_t const slotted{ batch.size() };
+
+			for (auto& handle : m_tracked)
+			{
+				//the delegate may have dropped it already, e.g. with clear_all_subscriptions
+				if (handle.m_boundDelegate)
+				{
+					batch.push_back(&handle);
+				}
+			}
+			//group by delegate, then by address, which is the order unsubscribe_batch expects
+			std::sort(batch.begin() + static_cast<std::ptrdiff_t>(slotted), batch.end(), [&before](delegate_handle const* a, delegate_handle const* b)
+			{
+				return a->m_boundDelegate != b->m_boundDelegate ? before(a->m_boundDelegate, b->m_boundDelegate) : before(a, b);
+			});
+
+			unsubscribe_runs(batch.data(), batch.data() + slotted);
+			unsubscribe_runs(batch.data() + slotted, batch.data() + batch.size());
+
+			//anything still attached is unsubscribed as usual
+			m_slotted.clear();
+			m_tracked.clear();
+		}
+
+		//Returns the number of handles in the group, including any their delegates have since dropped.
+		size_t size() const
+		{
+			return m_slotted.size() + m_tracked.size();
+		}
+
+		bool empty() const
+		{
+			return m_slotted.empty() && m_tracked.empty();
+		}
+	};
+}
+#endif
@@ -0,0 +1,505 @@
+#ifndef YADI_DELEGATE_INSTRUMENTATION_H
+#define YADI_DELEGATE_INSTRUMENTATION_H
+/************************************************************************
+ delegate_instrumentation :
+	This contains the optional dispatch instrumentation used by
+	yadi::delegate and yadi::delegate_fast.
+
+	- It is off unless YADI_INSTRUMENTATION is defined to 1 before
+	  including YADI (do it for the whole project, not per file).
+	  When off, every hook is an empty inline function on an empty
+	  member, so delegates are exactly as big and as fast as without it.
+
+	- When on, every delegate records how many times it executed, and
+	  the total and longest time each execution took.
+
+	- yadi::delegate can also time each listener separately, with a
+	  histogram of call times. That reads the clock twice per listener
+	  call, so it's off until set_listener_timing(true) is called on
+	  the delegate.
+
+	- Name delegates with set_name() so the reports are readable.
+
+	- instrumentation::registry finds every live delegate, for dumping
+	  the hottest delegates and slowest listeners. The numbers aren't
+	  synchronized: query them from the thread that runs the delegates
+	  (at the end of a frame, say), or while they're idle.
+
+	- Copies of a delegate record their own executions, but not
+	  per-listener timings.
+
+*************************************************************************/
+
+//Define this to 1 before including YADI to turn instrumentation on.
+#ifndef YADI_INSTRUMENTATION
+#define YADI_INSTRUMENTATION 0
+#endif
+
+//Marks the instrumentation members, so they take no space when it's off.
+//MSVC ignores the standard attribute (for ABI reasons), and has its own instead.
+#ifndef YADI_NO_UNIQUE_ADDRESS
+#if defined(_MSC_VER) && !defined(__clang__)
+#define YADI_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define YADI_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+#endif
+
+#include "delegate_util.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if YADI_INSTRUMENTATION
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#endif
+
+YADI_EXPORT namespace yadi
+{
+	namespace instrumentation
+	{
+		//How long something took, over every time it happened.
+		struct timing
+		{
+			uint64_t count{ 0 };
+			uint64_t total_ns{ 0 };
+			uint64_t max_ns{ 0 };
+
+			void record(uint64_t ns)
+			{
+				++count;
+				total_ns += ns;
+				if (ns > max_ns)
+				{
+					max_ns = ns;
+				}
+			}
+
+			double mean_ns() const
+			{
+				return count ? static_cast<double>(total_ns) / static_cast<double>(count) : 0.0;
+			}
+		};
+
+		//Call times, bucketed by powers of two: bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds.
+		struct latency_histogram
+		{
+			static constexpr size_t bucket_count{ 32 };
+			uint64_t buckets[bucket_count]{};
+
+			void record(uint64_t ns)
+			{
+				size_t bucket{ 0 };
+				while (ns > 1 && bucket + 1 < bucket_count)
+				{
+					ns >>= 1;
+					++bucket;
+				}
+				++buckets[bucket];
+			}
+
+			/*
+			* Params:
+			*	- fraction
+			*		Between 0 and 1, e.g. 0.99 for the 99th percentile.
+			*
+			* Returns:
+			*	An upper bound, in nanoseconds, on how long that fraction of calls took.
+			*/
+			uint64_t percentile(double fraction) const
+			{
+				uint64_t total{ 0 };
+				for (uint64_t count : buckets)
+				{
+					total += count;
+				}
+
+				uint64_t const wanted{ static_cast<uint64_t>(fraction * static_cast<double>(total)) };
+				uint64_t seen{ 0 };
+				for (size_t i{ 0 }; i < bucket_count; ++i)
+				{
+					seen += buckets[i];
+					if (seen >= wanted && seen != 0)
+					{
+						return uint64_t{ 2 } << i;
+					}
+				}
+				return 0;
+			}
+		};
+
+		//One delegate, as reported by the registry.
+		struct delegate_report
+		{
+			std::string name;
+			timing dispatch;
+		};
+
+		//One listener, as reported by the registry.
+		struct listener_report
+		{
+			//the name of the delegate it's subscribed to
+			std::string delegate_name;
+			//numbers the delegate's subscriptions in the order they were made, starting from 0
+			uint64_t id;
+			timing calls;
+			latency_histogram histogram;
+		};
+
+#if YADI_INSTRUMENTATION
+		using clock_type = std::chrono::steady_clock;
+
+		inline uint64_t elapsed_ns(clock_type::time_point start)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+		}
+
+		//Kept alongside each listener.
+		struct listener_record
+		{
+			uint64_t id{ 0 };
+			timing calls;
+			latency_histogram histogram;
+
+			listener_record() = default;
+
+			explicit listener_record(uint64_t listener_id)
+				: id{ listener_id }
+			{
+			}
+		};
+
+		class delegate_record;
+
+		//Keeps track of every live delegate. See the top of this file.
+		class registry
+		{
+		private:
+			std::mutex m_lock;
+			std::vector<delegate_record*> m_records;
+
+			friend class delegate_record;
+
+			void add(delegate_record* record)
+			{
+				std::lock_guard<std::mutex> lock{ m_lock };
+				m_records.push_back(record);
+			}
+
+			void remove(delegate_record* record)
+			{
+				std::lock_guard<std::mutex> lock{ m_lock };
+				std::erase(m_records, record);
+			}
+
+		public:
+			static registry& instance()
+			{
+				static registry shared;
+				return shared;
+			}
+
+			//Calls fn(delegate_record&) for every live delegate.
+			template<typename F>
+			void visit(F&& fn)
+			{
+				std::lock_guard<std::mutex> lock{ m_lock };
+				for (delegate_record* record : m_records)
+				{
+					fn(*record);
+				}
+			}
+
+			//Returns up to count delegates, the ones that spent the most time executing first.
+			std::vector<delegate_report> hottest_delegates(size_t count);
+
+			//Returns up to count listeners of delegates with listener timing on, the ones with the longest single call first.
+			std::vector<listener_report> slowest_listeners(size_t count);
+
+			//Zeroes every delegate's and listener's numbers.
+			void reset();
+		};
+
+		//Measures one execution of a delegate, from construction to destruction.
+		class dispatch_timer
+		{
+		private:
+			timing& m_timing;
+			clock_type::time_point m_start{ clock_type::now() };
+
+		public:
+			explicit dispatch_timer(timing& target)
+				: m_timing{ target }
+			{
+			}
+
+			dispatch_timer(dispatch_timer const&) = delete;
+			dispatch_timer& operator=(dispatch_timer const&) = delete;
+
+			~dispatch_timer()
+			{
+				m_timing.record(elapsed_ns(m_start));
+			}
+		};
+
+		//Measures one listener call, if listener timing is on.
+		class listener_timer
+		{
+		private:
+			listener_record* m_record;
+			clock_type::time_point m_start;
+
+		public:
+			explicit listener_timer(listener_record* record)
+				: m_record{ record }
+			{
+				if (m_record)
+				{
+					m_start = clock_type::now();
+				}
+			}
+
+			listener_timer(listener_timer const&) = delete;
+			listener_timer& operator=(listener_timer const&) = delete;
+
+			~listener_timer()
+			{
+				if (m_record)
+				{
+					uint64_t const ns{ elapsed_ns(m_start) };
+					m_record->calls.record(ns);
+					m_record->histogram.record(ns);
+				}
+			}
+		};
+
+		//Calls visit(listener) for each of a delegate's listeners.
+		using listener_visitor = util::inplace_function<void(listener_record&)>;
+
+		//A delegate's instrumentation. Every instrumented delegate holds one.
+		class delegate_record
+		{
+		private:
+			std::string m_name;
+			timing m_dispatch;
+			uint64_t m_nextListenerId{ 0 };
+			bool m_listenerTiming{ false };
+
+			//lets the registry walk the owner's listeners without knowing its type
+			void* m_owner{ nullptr };
+			void(*m_visitListeners)(void*, listener_visitor const&) { nullptr };
+
+			friend class registry;
+
+		public:
+			delegate_record()
+			{
+				registry::instance().add(this);
+			}
+
+			//a copy starts counting from scratch, and doesn't know where its owner's listeners are
+			delegate_record(delegate_record const& other)
+				: m_name{ other.m_name }
+			{
+				registry::instance().add(this);
+			}
+
+			delegate_record& operator=(delegate_record const& other)
+			{
+				m_name = other.m_name;
+				return *this;
+			}
+
+			~delegate_record()
+			{
+				registry::instance().remove(this);
+			}
+
+			/*
+			* Called by the owning delegate, so the registry can find its listeners.
+			*
+			* Params:
+			*	- owner
+			*		The delegate.
+			*	- visit
+			*		Calls the visitor for each of owner's listeners.
+			*/
+			void bind_listeners(void* owner, void(*visit)(void*, listener_visitor const&))
+			{
+				m_owner = owner;
+				m_visitListeners = visit;
+			}
+
+			void set_name(std::string name)
+			{
+				m_name = std::move(name);
+			}
+
+			std::string const& name() const
+			{
+				return m_name;
+			}
+
+			void set_listener_timing(bool enabled)
+			{
+				m_listenerTiming = enabled;
+			}
+
+			bool listener_timing() const
+			{
+				return m_listenerTiming;
+			}
+
+			timing const& dispatch() const
+			{
+				return m_dispatch;
+			}
+
+			//Returns an id for a new listener's listener_record.
+			uint64_t next_listener_id()
+			{
+				return m_nextListenerId++;
+			}
+
+			//Keep the result alive for the whole execution.
+			[[nodiscard]] dispatch_timer time_dispatch()
+			{
+				return dispatch_timer{ m_dispatch };
+			}
+
+			//Keep the result alive for the whole listener call.
+			[[nodiscard]] listener_timer time_listener(listener_record& listener)
+			{
+				return listener_timer{ m_listenerTiming ? &listener : nullptr };
+			}
+
+			//Calls visit(listener) for each listener of the owning delegate, if it has any and they're timed.
+			void visit_listeners(listener_visitor const& visit)
+			{
+				if (m_visitListeners && m_listenerTiming)
+				{
+					m_visitListeners(m_owner, visit);
+				}
+			}
+
+			void reset()
+			{
+				m_dispatch = timing{};
+				if (m_visitListeners)
+				{
+					m_visitListeners(m_owner, [](listener_record& listener)
+					{
+						listener.calls = timing{};
+						listener.histogram = latency_histogram{};
+					});
+				}
+			}
+		};
+
+		inline std::vector<delegate_report> registry::hottest_delegates(size_t count)
+		{
+			std::vector<delegate_report> reports;
+			visit([&reports](delegate_record& record)
+			{
+				reports.push_back(delegate_report{ record.name(), record.dispatch() });
+			});
+
+			std::sort(reports.begin(), reports.end(), [](delegate_report const& a, delegate_report const& b)
+			{
+				return a.dispatch.total_ns > b.dispatch.total_ns;
+			});
+			if (reports.size() > count)
+			{
+				reports.resize(count);
+			}
+			return reports;
+		}
+
+		inline std::vector<listener_report> registry::slowest_listeners(size_t count)
+		{
+			std::vector<listener_report> reports;
+			visit([&reports](delegate_record& record)
+			{
+				std::string const* name{ &record.name() };
+				record.visit_listeners([&reports, name](listener_record& listener)
+				{
+					reports.push_back(listener_report{ *name, listener.id, listener.calls, listener.histogram });
+				});
+			});
+
+			std::sort(reports.begin(), reports.end(), [](listener_report const& a, listener_report const& b)
+			{
+				return a.calls.max_ns > b.calls.max_ns;
+			});
+			if (reports.size() > count)
+			{
+				reports.resize(count);
+			}
+			return reports;
+		}
+
+		inline void registry::reset()
+		{
+			visit([](delegate_record& record)
+			{
+				record.reset();
+			});
+		}
+#else
+		//Everything below does nothing, and takes no space as a YADI_NO_UNIQUE_ADDRESS member.
+
+		struct listener_record
+		{
+			listener_record() = default;
+			explicit listener_record(uint64_t) {}
+		};
+
+		struct dispatch_timer {};
+		struct listener_timer {};
+
+		class delegate_record
+		{
+		public:
+			//the visitor is never called (or even instantiated, if it's a generic lambda)
+			template<typename F>
+			void bind_listeners(void*, F&&) {}
+			void set_name(std::string const&) {}
+			void set_listener_timing(bool) {}
+			uint64_t next_listener_id() { return 0; }
+			dispatch_timer time_dispatch() { return {}; }
+			listener_timer time_listener(listener_record&) { return {}; }
+		};
+
+		//makes sure the records really take no space on this compiler, so delegates stay as small as without them
+		struct empty_record_check
+		{
+			void* member;
+			YADI_NO_UNIQUE_ADDRESS delegate_record stats;
+			YADI_NO_UNIQUE_ADDRESS listener_record listenerStats;
+		};
+		static_assert(sizeof(empty_record_check) == sizeof(void*), "yadi::instrumentation: the empty records take up space. Check YADI_NO_UNIQUE_ADDRESS for this compiler.");
+
+		//Without instrumentation there is never anything to report.
+		class registry
+		{
+		public:
+			static registry& instance()
+			{
+				static registry shared;
+				return shared;
+			}
+
+			template<typename F>
+			void visit(F&&) {}
+
+			std::vector<delegate_report> hottest_delegates(size_t) { return {}; }
+			std::vector<listener_report> slowest_listeners(size_t) { return {}; }
+			void reset() {}
+		};
+#endif
+	}
+}
+#endif
@@ -0,0 +1,348 @@
+#ifndef YADI_DELEGATE_INTERRUPTIBLE_H
+#define YADI_DELEGATE_INTERRUPTIBLE_H
+/************************************************************************
+ delegate_interruptible :
+	This contains the functionality for the yadi::delegate_interruptible class.
+	yadi::delegate_interruptible has the following restrictions and features:
+
+	- Listeners return a value. As long as they return the delegate's
+	  "continue value" (Ret{} unless you say otherwise, so false for bool),
+	  execution moves on to the next listener.
+
+	- The first listener to return anything else interrupts the delegate.
+	  No further listeners are called, and the delegate reports which
+	  listener interrupted and what it returned.
+
+	- Listeners are called in the order they subscribed. Moving a handle
+	  does not change its place in line.
+
+	- Subscription lifetimes work exactly like yadi::delegate, using the
+	  same delegate_handle. Like compact_delegate, handles remember where
+	  their subscription is, so unsubscribing and moving them never
+	  searches. Removed subscriptions leave a hole that is closed up
+	  (keeping everyone's place in line) once holes make up half the
+	  array. Destroying the delegate detaches its handles.
+
+	- Listeners must not subscribe or unsubscribe from this delegate
+	  while it is executing.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	//The outcome of executing a delegate_interruptible.
+	template<typename Ret>
+	struct interrupt_result
+	{
+		//The handle of the listener that interrupted execution, or nullptr if every listener ran.
+		delegate_handle const* interrupted_by{ nullptr };
+
+		//What the interrupting listener returned, or the continue value if nobody interrupted.
+		Ret value;
+
+		//Returns true if a listener interrupted execution.
+		explicit operator bool() const
+		{
+			return interrupted_by != nullptr;
+		}
+	};
+
+	template<typename Ret, typename... Args>
+	class delegate_interruptible : delegate_base
+	{
+		static_assert(!std::is_void_v<Ret>, "yadi::delegate_interruptible: listeners must return a value. Use yadi::delegate for void listeners.");
+
+	private:
+		using callback_type = Ret(Args...);
+
+		//a handle's position is its entry's index
+		struct entry
+		{
+			//nullptr while this entry is a hole
+			delegate_handle* handle;
+			util::inplace_function<callback_type> callback;
+		};
+
+		//a vector, because call order matters here, and it must follow subscription order
+		std::pmr::vector<entry> m_callbacks;
+		size_t m_holes{ 0 };
+
+		Ret m_continueValue;
+
+		//leaves a hole, so nobody else moves
+		void remove(uint32_t index)
+		{
+			entry& item{ m_callbacks[index] };
+			item.handle = nullptr;
+			item.callback = util::inplace_function<callback_type>{};
+			++m_holes;
+		}
+
+		//Closes up the holes once they are half the array, keeping everyone in order.
+		//Each entry moves at most once per hole made since the last time, so removal stays constant time on average.
+		void settle()
+		{
+			if (m_holes * 2 < m_callbacks.size())
+			{
+				return;
+			}
+			size_t kept{ 0 };
+			for (size_t i{ 0 }; i < m_callbacks.size(); ++i)
+			{
+				if (m_callbacks[i].handle)
+				{
+					if (kept != i)
+					{
+						m_callbacks[kept] = std::move(m_callbacks[i]);
+						notify_handle_placed(*m_callbacks[kept].handle, static_cast<uint32_t>(kept));
+					}
+					++kept;
+				}
+			}
+			m_callbacks.erase(m_callbacks.begin() + static_cast<std::ptrdiff_t>(kept), m_callbacks.end());
+			m_holes = 0;
+		}
+
+		//see delegate_base::unsubscribe_batch. Each removal is already constant time,
+		//so this just closes the holes once at the end.
+		void unsubscribe_batch(delegate_handle* const* handles, size_t count) override
+		{
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				if (owns_handle(*handles[i]))
+				{
+					remove(handle_position(*handles[i]));
+					notify_handle_unsubscribed(*handles[i]);
+				}
+			}
+			settle();
+		}
+
+	public:
+		/*
+		* Params:
+		*	- continue_value
+		*		The value listeners return to let execution continue. Returning anything else interrupts the delegate.
+		*	- resource
+		*		Where to allocate subscriptions from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the delegate.
+		*/
+		explicit delegate_interruptible(Ret continue_value = Ret{}, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_callbacks{ resource }, m_continueValue{ std::move(continue_value) }
+		{
+		}
+
+		delegate_interruptible(delegate_interruptible const&) = delete;
+		delegate_interruptible& operator=(delegate_interruptible const&) = delete;
+
+		//handles that outlive the delegate are detached, rather than left pointing at it
+		~delegate_interruptible()
+		{
+			clear_all_subscriptions();
+		}
+
+		/*
+		* Given a member function pointer (&Coffee::Brew) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The member function to subscribe. Its signature must match the one provided by the delegate.
+		*	- instance
+		*		A pointer to the object to call the function on. It must be valid to call the given member function on it.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<typename T>
+		delegate_handle subscribe(Ret(T::* fn)(Args...), T* instance)
+		{
+			return subscribe(util::attach(fn, instance));
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<typename T>
+		delegate_handle subscribe(Ret(T::* fn)(Args...), T& instance)
+		{
+			return subscribe(fn, &instance);
+		}
+
+		/*
+		* Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->Fn(Args...).
+		*
+		* Template params:
+		*	- Fn
+		*		The member function to subscribe. It must be callable on T with the delegate's arguments.
+		*
+		* Params:
+		*	- instance
+		*		A pointer to the object to call the function on.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T* instance)
+		{
+			static_assert(std::is_invocable_r_v<Ret, decltype(Fn), T*, Args...>, "yadi::delegate_interruptible: Fn can't be called on T with this delegate's arguments.");
+			return subscribe(util::member_caller<Fn, T>{ instance });
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the delegate_handle returned does not outlive the object.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(T& instance)
+		{
+			return subscribe<Fn>(&instance);
+		}
+
+		//Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate.
+		template<auto Fn>
+		delegate_handle subscribe()
+		{
+			static_assert(std::is_invocable_r_v<Ret, decltype(Fn), Args...>, "yadi::delegate_interruptible: Fn can't be called with this delegate's arguments.");
+			return subscribe(util::free_caller<Fn>{});
+		}
+
+		/*
+		* Given any function object (lambda, function pointer, functor, etc), subscribe it to this delegate.
+		* The resulting call from the delegate will be the same as if you had done fn(Args...).
+		*
+		* Params:
+		* 	- fn
+		*		The function to call. This can be any type that will construct a valid util::inplace_function.
+		*		An empty function isn't subscribed.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription (or an empty one, if fn was empty).
+		*	When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe(util::inplace_function<callback_type> fn)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				return handle;
+			}
+			m_callbacks.push_back(entry{ &handle, std::move(fn) });
+			notify_handle_placed(handle, static_cast<uint32_t>(m_callbacks.size() - 1));
+			return handle;
+		}
+
+		/*
+		* Given a delegate_handle (representing a valid subscription),
+		* remove the subscription and deactivate the handle. If the
+		* handle doesn't belong to this delegate, do nothing.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*/
+		void unsubscribe(delegate_handle& handle) override
+		{
+			if (!owns_handle(handle))
+			{
+				return;
+			}
+
+			remove(handle_position(handle));
+			notify_handle_unsubscribed(handle);
+			settle();
+		}
+
+		/*
+		* Transfers ownership of a delegate subscription from one handle to another.
+		* This assumes that the old handle is connected to this delegate already.
+		* If it isn't, calling this has no effect. Handles carry their position with them, so this is constant time.
+		*
+		* Params:
+		*	- old_handle
+		*		The handle to move the subscription away from. This handle should be subscribed to this delegate already.
+		*	- new_handle
+		*		The handle to move the subscription to. If it already owns another subscription, that one will be removed.
+		*/
+		void move_subscription(delegate_handle& old_handle, delegate_handle& new_handle) override
+		{
+			if (owns_handle(old_handle))
+			{
+				uint32_t const index{ handle_position(old_handle) };
+				m_callbacks[index].handle = &new_handle;
+				notify_handle_unsubscribed(old_handle);
+				notify_handle_placed(new_handle, index);
+			}
+		}
+
+		/*
+		* Execute the underlying delegate, passing along the appropriate args.
+		* Listeners are called in subscription order, until one of them returns
+		* something other than the continue value.
+		* Arguments are passed to every listener as they are, without being copied or moved.
+		*
+		* Returns:
+		*	An interrupt_result saying which listener interrupted (if any) and what it returned.
+		*/
+		interrupt_result<Ret> operator()(util::param_t<Args>... args)
+		{
+			for (auto& item : m_callbacks)
+			{
+				if (!item.handle)
+				{
+					continue;
+				}
+				Ret value{ item.callback.call_shared(std::forward<util::param_t<Args>>(args)...) };
+				if (!(value == m_continueValue))
+				{
+					return interrupt_result<Ret>{ item.handle, std::move(value) };
+				}
+			}
+			return interrupt_result<Ret>{ nullptr, m_continueValue };
+		}
+
+		//Returns the value listeners return to let execution continue.
+		Ret const& continue_value() const
+		{
+			return m_continueValue;
+		}
+
+		//Returns the number of functions currently subscribed to this delegate.
+		size_t subscriber_count() const
+		{
+			return m_callbacks.size() - m_holes;
+		}
+
+		//Returns the bytes this delegate has allocated, on top of sizeof(delegate_interruptible): its array, holes and spare capacity included.
+		size_t memory_usage() const
+		{
+			return m_callbacks.capacity() * sizeof(entry);
+		}
+
+		//Force-removes all subscribers from this delegate immediately.
+		void clear_all_subscriptions()
+		{
+			for (auto& item : m_callbacks)
+			{
+				if (item.handle)
+				{
+					notify_handle_unsubscribed(*item.handle);
+				}
+			}
+			m_callbacks.clear();
+			m_holes = 0;
+		}
+	};
+}
+#endif
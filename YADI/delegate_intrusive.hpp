@@ -0,0 +1,368 @@
+#ifndef YADI_DELEGATE_INTRUSIVE_H
+#define YADI_DELEGATE_INTRUSIVE_H
+/************************************************************************
+ delegate_intrusive :
+	This contains the functionality for the yadi::intrusive_delegate class.
+	yadi::intrusive_delegate has the following restrictions and features:
+
+	- Each subscription lives entirely inside its handle: the callback,
+	  and the links to the subscriptions before and after it. The
+	  delegate itself is only the two ends of that list.
+
+	- Subscribing, unsubscribing and moving a handle are all a few pointer
+	  updates. The delegate never allocates anything.
+
+	- Handles are yadi::intrusive_handle<Args...> rather than
+	  delegate_handle, since they carry the callback. They can't be put
+	  in a subscription_group.
+
+	- Destroying the delegate detaches every handle still subscribed to
+	  it, so handles may safely outlive their delegate.
+
+	- Listeners are called in the order they subscribed. Executing the
+	  delegate walks the handles, wherever they are in memory, so prefer
+	  yadi::delegate_fast for big listener counts that execute often.
+
+	- Listeners may subscribe, unsubscribe, destroy or move handles while
+	  the delegate is executing, with the same results as yadi::delegate:
+	  removed subscriptions are never called again, new ones start with
+	  the next execution, and moved ones keep their place.
+	  The one exception is the handle a listener is being called from,
+	  since its callback is the code running: the listener may unsubscribe
+	  it or move it (the new handle gets a copy of the callback, and the
+	  call carries on in the old one), but must not destroy it or move
+	  another subscription into it before returning.
+
+	- Arguments are shared between listeners exactly as yadi::delegate
+	  does it.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_util.hpp"
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+YADI_EXPORT namespace yadi
+{
+	template<typename... Args>
+	class intrusive_delegate;
+
+	template<typename... Args>
+	class intrusive_handle
+	{
+	public:
+		intrusive_handle() = default;
+
+		intrusive_handle(intrusive_handle const&) = delete;
+		intrusive_handle& operator=(intrusive_handle const&) = delete;
+
+		//the new handle takes the old one's place in the list
+		intrusive_handle(intrusive_handle&& other) noexcept
+		{
+			take_subscription(other);
+		}
+
+		intrusive_handle& operator=(intrusive_handle&& other) noexcept
+		{
+			if (this != &other)
+			{
+				unsubscribe();
+				take_subscription(other);
+			}
+			return *this;
+		}
+
+		~intrusive_handle()
+		{
+			unsubscribe();
+		}
+
+		//manually detach this handle from its delegate
+		//(the callback stays until the handle goes, in case it's the one running)
+		void unsubscribe()
+		{
+			if (m_owner)
+			{
+				m_owner->unlink(*this);
+			}
+		}
+
+		//Returns whether this handle currently holds a subscription.
+		bool is_subscribed() const
+		{
+			return m_owner != nullptr;
+		}
+
+	private:
+		friend class intrusive_delegate<Args...>;
+
+		using callback_type = util::inplace_function<void(Args...)>;
+
+		intrusive_delegate<Args...>* m_owner{ nullptr };
+		intrusive_handle* m_previous{ nullptr };
+		intrusive_handle* m_next{ nullptr };
+		//numbers subscriptions in the order they were made, so an execution can skip newer ones
+		uint64_t m_order{ 0 };
+		callback_type m_callback;
+
+		intrusive_handle(intrusive_delegate<Args...>& owner, callback_type&& callback)
+			: m_callback{ std::move(callback) }
+		{
+			if (m_callback)
+			{
+				owner.link(*this);
+			}
+		}
+
+		//expects this not to be subscribed
+		void take_subscription(intrusive_handle& other)
+		{
+			if (other.m_owner)
+			{
+				//a callback that is running stays where it is until it returns, so the new handle gets a copy
+				if (other.m_owner->is_running(other))
+				{
+					m_callback = other.m_callback;
+				}
+				else
+				{
+					m_callback = std::move(other.m_callback);
+				}
+				other.m_owner->replace(other, *this);
+			}
+		}
+	};
+
+	template<typename... Args>
+	class intrusive_delegate
+	{
+	private:
+		using handle_type = intrusive_handle<Args...>;
+		using callback_type = typename handle_type::callback_type;
+
+		friend class intrusive_handle<Args...>;
+
+		handle_type* m_first{ nullptr };
+		handle_type* m_last{ nullptr };
+		size_t m_count{ 0 };
+		uint64_t m_nextOrder{ 0 };
+
+		//One per running execution (more than one if a listener executes the delegate again),
+		//linked from the innermost out. Handles that unlink or move fix these up.
+		struct cursor
+		{
+			//the next handle this execution will visit
+			handle_type* next;
+			cursor* outer;
+			//the handle whose callback this execution is in
+			handle_type* running;
+		};
+
+		//Takes an execution's cursor back off the list, however the execution ends.
+		//Kept apart from the cursor, whose address is handed out, so the compiler can see where it writes.
+		struct cursor_scope
+		{
+			intrusive_delegate* owner;
+			cursor* outer;
+
+			~cursor_scope()
+			{
+				owner->m_cursors = outer;
+			}
+		};
+
+		cursor* m_cursors{ nullptr };
+
+		void link(handle_type& handle)
+		{
+			handle.m_owner = this;
+			handle.m_order = m_nextOrder++;
+			handle.m_previous = m_last;
+			handle.m_next = nullptr;
+			(m_last ? m_last->m_next : m_first) = &handle;
+			m_last = &handle;
+			++m_count;
+		}
+
+		void unlink(handle_type& handle)
+		{
+			for (cursor* item{ m_cursors }; item; item = item->outer)
+			{
+				if (item->next == &handle)
+				{
+					item->next = handle.m_next;
+				}
+			}
+
+			(handle.m_previous ? handle.m_previous->m_next : m_first) = handle.m_next;
+			(handle.m_next ? handle.m_next->m_previous : m_last) = handle.m_previous;
+			handle.m_owner = nullptr;
+			handle.m_previous = nullptr;
+			handle.m_next = nullptr;
+			--m_count;
+		}
+
+		bool is_running(handle_type const& handle) const
+		{
+			for (cursor const* item{ m_cursors }; item; item = item->outer)
+			{
+				if (item->running == &handle)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//puts new_handle exactly where old_handle was. The callback has already been moved over.
+		void replace(handle_type& old_handle, handle_type& new_handle)
+		{
+			for (cursor* item{ m_cursors }; item; item = item->outer)
+			{
+				if (item->next == &old_handle)
+				{
+					item->next = &new_handle;
+				}
+			}
+
+			new_handle.m_owner = this;
+			new_handle.m_order = old_handle.m_order;
+			new_handle.m_previous = old_handle.m_previous;
+			new_handle.m_next = old_handle.m_next;
+			(new_handle.m_previous ? new_handle.m_previous->m_next : m_first) = &new_handle;
+			(new_handle.m_next ? new_handle.m_next->m_previous : m_last) = &new_handle;
+
+			old_handle.m_owner = nullptr;
+			old_handle.m_previous = nullptr;
+			old_handle.m_next = nullptr;
+		}
+
+	public:
+		intrusive_delegate() = default;
+
+		//handles point at the delegate, so it stays put
+		intrusive_delegate(intrusive_delegate const&) = delete;
+		intrusive_delegate& operator=(intrusive_delegate const&) = delete;
+
+		~intrusive_delegate()
+		{
+			clear_all_subscriptions();
+		}
+
+		/*
+		* Given a member function pointer (&Coffee::Brew) and a pointer to an instance,
+		* subscribe that function to this delegate. The resulting call from the delegate
+		* will be the same as if you had done instance->fn(Args...).
+		*
+		* Returns:
+		*	An intrusive_handle holding the subscription. When it goes out of scope, the subscription will be removed.
+		*/
+		template<typename T>
+		handle_type subscribe(void(T::* fn)(Args...), T* instance)
+		{
+			return subscribe(util::attach(fn, instance));
+		}
+
+		//Same as above, but takes the instance by reference.
+		//You must ensure that the handle returned does not outlive the object.
+		template<typename T>
+		handle_type subscribe(void(T::* fn)(Args...), T& instance)
+		{
+			return subscribe(fn, &instance);
+		}
+
+		//Given a member function known at compile time (subscribe<&Coffee::Brew>) and a pointer to an instance,
+		//subscribe that function to this delegate. The call to Fn gets inlined into the stored callback.
+		template<auto Fn, typename T>
+		handle_type subscribe(T* instance)
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), T*, Args...>, "yadi::intrusive_delegate: Fn can't be called on T with this delegate's arguments.");
+			return subscribe(util::member_caller<Fn, T>{ instance });
+		}
+
+		//Same as above, but takes the instance by reference.
+		template<auto Fn, typename T>
+		handle_type subscribe(T& instance)
+		{
+			return subscribe<Fn>(&instance);
+		}
+
+		//Given a free function known at compile time (subscribe<&brew_coffee>), subscribe it to this delegate.
+		template<auto Fn>
+		handle_type subscribe()
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), Args...>, "yadi::intrusive_delegate: Fn can't be called with this delegate's arguments.");
+			return subscribe(util::free_caller<Fn>{});
+		}
+
+		/*
+		* Given any function object (lambda, function pointer, functor, etc), subscribe it to this delegate.
+		* Subscribing an empty function does nothing, and returns an empty handle.
+		*
+		* Returns:
+		*	An intrusive_handle holding the subscription. When it goes out of scope, the subscription will be removed.
+		*/
+		handle_type subscribe(callback_type fn)
+		{
+			//built in place, so the handle links itself from where it will live
+			return handle_type{ *this, std::move(fn) };
+		}
+
+		//Remove the subscription held by handle. If it doesn't belong to this delegate, do nothing.
+		void unsubscribe(handle_type& handle)
+		{
+			if (handle.m_owner == this)
+			{
+				handle.unsubscribe();
+			}
+		}
+
+		//Execute the delegate, calling every listener in the order they subscribed.
+		//Arguments are passed to every listener as they are, without being copied or moved.
+		void operator()(util::param_t<Args>... args)
+		{
+			//subscriptions made from here on wait for the next execution
+			uint64_t const newest{ m_nextOrder };
+			cursor position{ m_first, m_cursors, nullptr };
+			cursor_scope const scope{ this, m_cursors };
+			m_cursors = &position;
+
+			while (handle_type* const handle{ position.next })
+			{
+				position.next = handle->m_next;
+				if (handle->m_order < newest)
+				{
+					position.running = handle;
+					handle->m_callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+				}
+			}
+		}
+
+		//Returns the number of functions currently subscribed to this delegate.
+		size_t subscriber_count() const
+		{
+			return m_count;
+		}
+
+		//Returns the bytes this delegate has allocated, which is always none: subscriptions live in their handles.
+		size_t memory_usage() const
+		{
+			return 0;
+		}
+
+		//Force-removes all subscribers from this delegate immediately.
+		//If the delegate is executing, no more listeners will be called.
+		void clear_all_subscriptions()
+		{
+			while (m_first)
+			{
+				m_first->unsubscribe();
+			}
+		}
+	};
+}
+#endif
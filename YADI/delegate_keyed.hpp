@@ -0,0 +1,744 @@
+#ifndef YADI_DELEGATE_KEYED_H
+#define YADI_DELEGATE_KEYED_H
+/************************************************************************
+ delegate_keyed :
+	This contains the functionality for the yadi::keyed_delegate class.
+	yadi::keyed_delegate has the following restrictions and features:
+
+	- Listeners subscribe to one key, and executing the delegate with a
+	  key only calls that key's listeners: subscribe(4711, on_damage)
+	  hears about entity 4711, and nothing else.
+
+	- Listeners can also subscribe_all(), to hear about every key. They
+	  are called after the key's own listeners, and are told the key.
+
+	- Keys are found through a flat, open-addressed hash table (using
+	  std::hash<Key>), so executing costs one lookup no matter how many
+	  keys have listeners. Keys nobody listens to any more are dropped.
+
+	- Handles are ordinary delegate_handles. Like delegate_fast, handles
+	  remember where their subscription lives, so unsubscribing never
+	  searches and moving them never calls the delegate. Handles of a
+	  cleared or destroyed delegate are left harmless.
+
+	- Removing a subscription swaps the last listener of its key into its
+	  place, so the order listeners are called in is NOT stable.
+
+	- Listeners may subscribe, unsubscribe, destroy or move handles while
+	  the delegate is executing. A removed subscription is never called
+	  again, and a new one starts with the next execution.
+
+	- Arguments are shared between listeners exactly as yadi::delegate
+	  does it.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_core.hpp"
+#include "delegate_instrumentation.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	template<typename Key, typename... Args>
+	class keyed_delegate : delegate_base
+	{
+	private:
+		using callback_type = void(Args...);
+		using wildcard_callback_type = void(Key const&, Args...);
+
+		//where a slot's listener lives, besides the buckets in m_buckets
+		static constexpr uint32_t wildcard_bucket{ UINT32_MAX };
+		static constexpr uint32_t pending_bucket{ UINT32_MAX - 1 };
+		static constexpr uint32_t pending_wildcard_bucket{ UINT32_MAX - 2 };
+		//an empty entry in m_index
+		static constexpr uint32_t no_bucket{ UINT32_MAX };
+
+		template<typename Callback>
+		struct listener
+		{
+			Callback callback;
+			uint32_t slot;
+			//unsubscribed while executing. Cleaned up once the outermost execution finishes.
+			bool removed{ false };
+		};
+
+		using key_listener = listener<util::inplace_function<callback_type>>;
+		using wildcard_listener = listener<util::inplace_function<wildcard_callback_type>>;
+
+		//every listener of one key
+		struct bucket
+		{
+			Key key;
+			size_t hash;
+			std::pmr::vector<key_listener> listeners;
+			//has listeners flagged as removed
+			bool dirty{ false };
+		};
+
+		//subscribed while executing, added to its bucket once the outermost execution finishes
+		struct pending_listener
+		{
+			Key key;
+			key_listener item;
+		};
+
+		std::pmr::memory_resource* m_resource;
+
+		//buckets are kept dense, and found through m_index
+		std::pmr::vector<bucket> m_buckets;
+		//linear probing over bucket numbers, a power of two in size, no more than 3/4 full
+		std::pmr::vector<uint32_t> m_index;
+
+		std::pmr::vector<wildcard_listener> m_wildcard;
+		bool m_wildcardDirty{ false };
+
+		std::pmr::vector<pending_listener> m_pending;
+		std::pmr::vector<wildcard_listener> m_pendingWildcard;
+		//buckets with listeners flagged as removed
+		std::pmr::vector<uint32_t> m_dirty;
+
+		//as in delegate_fast, handles remember their slot, so finding a subscription is an array lookup
+		struct slot
+		{
+			uint32_t generation;
+			//which bucket the listener is in, or one of wildcard_bucket, pending_bucket and pending_wildcard_bucket
+			uint32_t bucket;
+			//the position in that bucket while used, or the next free slot while not
+			uint32_t index;
+			bool used;
+		};
+
+		std::pmr::vector<slot> m_slots;
+		uint32_t m_freeSlot{ delegate_handle::no_slot };
+		size_t m_count{ 0 };
+
+		//what our handles are bound to, made on the first subscription
+		handle_anchor<keyed_delegate>* m_anchor{ nullptr };
+		friend class handle_anchor<keyed_delegate>;
+
+		unsigned m_dispatchDepth{ 0 };
+
+		//see delegate_instrumentation.hpp. Takes no space unless YADI_INSTRUMENTATION is on.
+		YADI_NO_UNIQUE_ADDRESS instrumentation::delegate_record m_stats;
+
+		//std::hash is often the identity for integers, so the bits are mixed before picking a position
+		static size_t hash_of(Key const& key)
+		{
+			uint64_t mixed{ static_cast<uint64_t>(std::hash<Key>{}(key)) };
+			mixed ^= mixed >> 32;
+			mixed *= 0x9E3779B97F4A7C15ull;
+			mixed ^= mixed >> 29;
+			return static_cast<size_t>(mixed);
+		}
+
+		size_t index_mask() const
+		{
+			return m_index.size() - 1;
+		}
+
+		//returns the bucket for key, or no_bucket
+		uint32_t find_bucket(Key const& key, size_t hash) const
+		{
+			if (m_index.empty())
+			{
+				return no_bucket;
+			}
+			for (size_t position{ hash & index_mask() };; position = (position + 1) & index_mask())
+			{
+				uint32_t const id{ m_index[position] };
+				if (id == no_bucket || (m_buckets[id].hash == hash && m_buckets[id].key == key))
+				{
+					return id;
+				}
+			}
+		}
+
+		//returns where in m_index bucket id is kept
+		size_t index_position(uint32_t id) const
+		{
+			size_t position{ m_buckets[id].hash & index_mask() };
+			while (m_index[position] != id)
+			{
+				position = (position + 1) & index_mask();
+			}
+			return position;
+		}
+
+		void place_in_index(uint32_t id)
+		{
+			size_t position{ m_buckets[id].hash & index_mask() };
+			while (m_index[position] != no_bucket)
+			{
+				position = (position + 1) & index_mask();
+			}
+			m_index[position] = id;
+		}
+
+		void rebuild_index(size_t size)
+		{
+			m_index.assign(size, no_bucket);
+			for (uint32_t id{ 0 }; id < m_buckets.size(); ++id)
+			{
+				place_in_index(id);
+			}
+		}
+
+		//returns the bucket for key, creating it if needed. Never call this while executing.
+		uint32_t get_bucket(Key const& key)
+		{
+			size_t const hash{ hash_of(key) };
+			uint32_t const found{ find_bucket(key, hash) };
+			if (found != no_bucket)
+			{
+				return found;
+			}
+
+			auto const id{ static_cast<uint32_t>(m_buckets.size()) };
+			m_buckets.push_back(bucket{ key, hash, std::pmr::vector<key_listener>{ m_resource } });
+			if (m_buckets.size() * 4 > m_index.size() * 3)
+			{
+				rebuild_index(m_index.empty() ? 16 : m_index.size() * 2);
+			}
+			else
+			{
+				place_in_index(id);
+			}
+			return id;
+		}
+
+		//drops an empty bucket, keeping both m_buckets and m_index dense. Never call this while executing.
+		void erase_bucket(uint32_t id)
+		{
+			//backward-shift deletion: pull later entries of the probe run back,
+			//so lookups never need tombstones. With plain linear probing an entry at its home
+			//doesn't end the run, so this goes on until an empty position.
+			size_t hole{ index_position(id) };
+			for (size_t next{ (hole + 1) & index_mask() }; m_index[next] != no_bucket; next = (next + 1) & index_mask())
+			{
+				//an entry whose home is (cyclically) in (hole, next] is still reachable, so it stays
+				size_t const home{ m_buckets[m_index[next]].hash & index_mask() };
+				if (((next - home) & index_mask()) >= ((next - hole) & index_mask()))
+				{
+					m_index[hole] = m_index[next];
+					hole = next;
+				}
+			}
+			m_index[hole] = no_bucket;
+
+			auto const last{ static_cast<uint32_t>(m_buckets.size() - 1) };
+			if (id != last)
+			{
+				m_index[index_position(last)] = id;
+				m_buckets[id] = std::move(m_buckets[last]);
+				for (auto const& item : m_buckets[id].listeners)
+				{
+					m_slots[item.slot].bucket = id;
+				}
+			}
+			m_buckets.pop_back();
+		}
+
+		uint32_t acquire_slot(uint32_t bucket_id, uint32_t index)
+		{
+			uint32_t id{ m_freeSlot };
+			if (id == delegate_handle::no_slot)
+			{
+				id = static_cast<uint32_t>(m_slots.size());
+				m_slots.push_back(slot{ 0, 0, 0, false });
+			}
+			else
+			{
+				m_freeSlot = m_slots[id].index;
+			}
+
+			m_slots[id].bucket = bucket_id;
+			m_slots[id].index = index;
+			m_slots[id].used = true;
+			++m_count;
+			return id;
+		}
+
+		void free_slot(uint32_t id)
+		{
+			slot& item{ m_slots[id] };
+			++item.generation;
+			item.used = false;
+			item.index = m_freeSlot;
+			m_freeSlot = id;
+			--m_count;
+		}
+
+		//swap the last listener into the freed spot so the array stays dense
+		template<typename Listener>
+		void swap_remove(std::pmr::vector<Listener>& listeners, uint32_t index)
+		{
+			size_t const last{ listeners.size() - 1 };
+			if (index != last)
+			{
+				listeners[index] = std::move(listeners[last]);
+				m_slots[listeners[index].slot].index = index;
+			}
+			listeners.pop_back();
+		}
+
+		//drops listeners flagged as removed, and fixes up the slots of the ones that move
+		template<typename Listener>
+		void compact(std::pmr::vector<Listener>& listeners)
+		{
+			size_t kept{ 0 };
+			for (size_t i{ 0 }; i < listeners.size(); ++i)
+			{
+				if (!listeners[i].removed)
+				{
+					if (kept != i)
+					{
+						listeners[kept] = std::move(listeners[i]);
+						m_slots[listeners[kept].slot].index = static_cast<uint32_t>(kept);
+					}
+					++kept;
+				}
+			}
+			listeners.erase(listeners.begin() + static_cast<std::ptrdiff_t>(kept), listeners.end());
+		}
+
+		template<typename Listener, typename Callback>
+		delegate_handle add_listener(std::pmr::vector<Listener>& listeners, uint32_t bucket_id, Callback&& fn)
+		{
+			delegate_handle handle;
+			if (!fn)
+			{
+				//nothing to call
+				return handle;
+			}
+			uint32_t const id{ acquire_slot(bucket_id, static_cast<uint32_t>(listeners.size())) };
+			listeners.push_back(Listener{ std::move(fn), id });
+			anchor().attach(handle, id, m_slots[id].generation);
+			return handle;
+		}
+
+		handle_anchor<keyed_delegate>& anchor()
+		{
+			if (!m_anchor)
+			{
+				m_anchor = new handle_anchor<keyed_delegate>{ this };
+			}
+			return *m_anchor;
+		}
+
+		//applies everything that was put off while executing
+		void settle()
+		{
+			//removals first, as buckets may disappear and renumber
+			for (uint32_t id : m_dirty)
+			{
+				m_buckets[id].dirty = false;
+				compact(m_buckets[id].listeners);
+			}
+			//highest numbers first, so erasing one never renumbers another that's still to be checked
+			std::sort(m_dirty.begin(), m_dirty.end(), std::greater<>{});
+			for (uint32_t id : m_dirty)
+			{
+				if (m_buckets[id].listeners.empty())
+				{
+					erase_bucket(id);
+				}
+			}
+			m_dirty.clear();
+
+			if (m_wildcardDirty)
+			{
+				m_wildcardDirty = false;
+				compact(m_wildcard);
+			}
+
+			for (auto& item : m_pending)
+			{
+				if (!item.item.removed)
+				{
+					uint32_t const id{ get_bucket(item.key) };
+					auto& listeners{ m_buckets[id].listeners };
+					m_slots[item.item.slot].bucket = id;
+					m_slots[item.item.slot].index = static_cast<uint32_t>(listeners.size());
+					listeners.push_back(std::move(item.item));
+				}
+			}
+			m_pending.clear();
+
+			for (auto& item : m_pendingWildcard)
+			{
+				if (!item.removed)
+				{
+					m_slots[item.slot].bucket = wildcard_bucket;
+					m_slots[item.slot].index = static_cast<uint32_t>(m_wildcard.size());
+					m_wildcard.push_back(std::move(item));
+				}
+			}
+			m_pendingWildcard.clear();
+		}
+
+		struct dispatch_scope
+		{
+			keyed_delegate& owner;
+
+			explicit dispatch_scope(keyed_delegate& dispatching)
+				: owner{ dispatching }
+			{
+				++owner.m_dispatchDepth;
+			}
+
+			~dispatch_scope()
+			{
+				if (--owner.m_dispatchDepth == 0)
+				{
+					owner.settle();
+				}
+			}
+		};
+
+		bool is_dispatching() const
+		{
+			return m_dispatchDepth != 0;
+		}
+
+		//see handle_anchor. A handle whose subscription was cleared may name a slot someone else has now.
+		void release_slot(uint32_t id, uint32_t generation)
+		{
+			if (id >= m_slots.size() || !m_slots[id].used || m_slots[id].generation != generation)
+			{
+				return;
+			}
+
+			slot const where{ m_slots[id] };
+			free_slot(id);
+			if (where.bucket == pending_bucket)
+			{
+				m_pending[where.index].item.removed = true;
+			}
+			else if (where.bucket == pending_wildcard_bucket)
+			{
+				m_pendingWildcard[where.index].removed = true;
+			}
+			else if (where.bucket == wildcard_bucket)
+			{
+				if (is_dispatching())
+				{
+					m_wildcard[where.index].removed = true;
+					m_wildcardDirty = true;
+				}
+				else
+				{
+					swap_remove(m_wildcard, where.index);
+				}
+			}
+			else if (is_dispatching())
+			{
+				bucket& owner{ m_buckets[where.bucket] };
+				owner.listeners[where.index].removed = true;
+				if (!owner.dirty)
+				{
+					owner.dirty = true;
+					m_dirty.push_back(where.bucket);
+				}
+			}
+			else
+			{
+				swap_remove(m_buckets[where.bucket].listeners, where.index);
+				if (m_buckets[where.bucket].listeners.empty())
+				{
+					erase_bucket(where.bucket);
+				}
+			}
+		}
+
+	public:
+		/*
+		* Params:
+		*	- resource
+		*		Where to allocate the key table and subscriptions from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the delegate.
+		*/
+		explicit keyed_delegate(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_resource{ resource }, m_buckets{ resource }, m_index{ resource }, m_wildcard{ resource },
+			m_pending{ resource }, m_pendingWildcard{ resource }, m_dirty{ resource }, m_slots{ resource }
+		{
+		}
+
+		keyed_delegate(keyed_delegate const&) = delete;
+		keyed_delegate& operator=(keyed_delegate const&) = delete;
+
+		//handles that outlive the delegate keep its anchor alive, rather than pointing at the delegate
+		~keyed_delegate()
+		{
+			if (m_anchor)
+			{
+				m_anchor->orphan();
+			}
+		}
+
+		/*
+		* Given any function object (lambda, function pointer, functor, etc), subscribe it to one key.
+		* It's called whenever the delegate is executed with that key, as fn(Args...).
+		*
+		* Params:
+		*	- key
+		*		The key to listen for.
+		*	- fn
+		*		The function to call. Subscribing an empty function does nothing, and returns an empty handle.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe(Key const& key, util::inplace_function<callback_type> fn)
+		{
+			if (!fn)
+			{
+				//nothing to call
+				return delegate_handle{};
+			}
+			if (!is_dispatching())
+			{
+				uint32_t const bucket_id{ get_bucket(key) };
+				return add_listener(m_buckets[bucket_id].listeners, bucket_id, std::move(fn));
+			}
+
+			//buckets can't be added to while executing, so this waits in m_pending
+			delegate_handle handle;
+			uint32_t const id{ acquire_slot(pending_bucket, static_cast<uint32_t>(m_pending.size())) };
+			m_pending.push_back(pending_listener{ key, key_listener{ std::move(fn), id } });
+			anchor().attach(handle, id, m_slots[id].generation);
+			return handle;
+		}
+
+		//Subscribe instance->fn(Args...) to one key.
+		template<typename T>
+		delegate_handle subscribe(Key const& key, void(T::* fn)(Args...), T* instance)
+		{
+			return subscribe(key, util::attach(fn, instance));
+		}
+
+		//Subscribe instance->Fn(Args...) to one key. The call to Fn gets inlined into the stored callback.
+		template<auto Fn, typename T>
+		delegate_handle subscribe(Key const& key, T* instance)
+		{
+			static_assert(std::is_invocable_v<decltype(Fn), T*, Args...>, "yadi::keyed_delegate: Fn can't be called on T with this delegate's arguments.");
+			return subscribe(key, util::member_caller<Fn, T>{ instance });
+		}
+
+		/*
+		* Subscribe to every key. The function is called as fn(key, Args...),
+		* after the listeners subscribed to that key.
+		*
+		* Returns:
+		*	A delegate_handle representing the subscription. When it goes out of scope, the subscription will be removed.
+		*	See the delegate_handle notes in delegate_core.hpp for more details.
+		*/
+		delegate_handle subscribe_all(util::inplace_function<wildcard_callback_type> fn)
+		{
+			if (!is_dispatching())
+			{
+				return add_listener(m_wildcard, wildcard_bucket, std::move(fn));
+			}
+
+			delegate_handle handle;
+			if (fn)
+			{
+				uint32_t const id{ acquire_slot(pending_wildcard_bucket, static_cast<uint32_t>(m_pendingWildcard.size())) };
+				m_pendingWildcard.push_back(wildcard_listener{ std::move(fn), id });
+				anchor().attach(handle, id, m_slots[id].generation);
+			}
+			return handle;
+		}
+
+		/*
+		* Given a delegate_handle (representing a valid subscription),
+		* remove the subscription and deactivate the handle. If the
+		* handle doesn't belong to this delegate, do nothing.
+		*
+		* Params:
+		*	- handle
+		*		The handle representing the subscription.
+		*/
+		void unsubscribe(delegate_handle& handle) override
+		{
+			if (m_anchor)
+			{
+				m_anchor->unsubscribe(handle);
+			}
+		}
+
+		//Handles from this delegate carry their slot with them, and move without calling this.
+		void move_subscription(delegate_handle&, delegate_handle&) override
+		{
+		}
+
+		/*
+		* Execute the delegate for one key: call that key's listeners, then every subscribe_all() listener.
+		* Arguments are passed to every listener as they are, without being copied or moved.
+		*
+		* Params:
+		*	- key
+		*		Whose listeners to call.
+		*	- args
+		*		The arguments to pass them.
+		*/
+		void operator()(Key const& key, util::param_t<Args>... args)
+		{
+			dispatch_scope scope{ *this };
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+
+			//nothing moves while executing (see m_pending), so these references stay good
+			uint32_t const id{ find_bucket(key, hash_of(key)) };
+			if (id != no_bucket)
+			{
+				for (auto& item : m_buckets[id].listeners)
+				{
+					if (!item.removed)
+					{
+						item.callback.call_shared(std::forward<util::param_t<Args>>(args)...);
+					}
+				}
+			}
+			for (auto& item : m_wildcard)
+			{
+				if (!item.removed)
+				{
+					item.callback.call_shared(key, std::forward<util::param_t<Args>>(args)...);
+				}
+			}
+		}
+
+		//Returns the number of functions currently subscribed to this delegate, to any key.
+		size_t subscriber_count() const
+		{
+			return m_count;
+		}
+
+		//Returns the number of functions currently subscribed to key, not counting subscribe_all() ones.
+		size_t subscriber_count(Key const& key) const
+		{
+			uint32_t const id{ find_bucket(key, hash_of(key)) };
+			if (id == no_bucket)
+			{
+				return 0;
+			}
+			size_t count{ 0 };
+			for (auto const& item : m_buckets[id].listeners)
+			{
+				count += item.removed ? 0 : 1;
+			}
+			return count;
+		}
+
+		//Returns the number of keys that have listeners.
+		size_t key_count() const
+		{
+			return m_buckets.size();
+		}
+
+		//Returns the bytes this delegate has allocated, on top of sizeof(keyed_delegate): every array, spare capacity included.
+		//Memory the keys themselves point to isn't counted.
+		size_t memory_usage() const
+		{
+			size_t total{ m_buckets.capacity() * sizeof(bucket) + m_index.capacity() * sizeof(uint32_t)
+				+ m_wildcard.capacity() * sizeof(wildcard_listener) + m_pending.capacity() * sizeof(pending_listener)
+				+ m_pendingWildcard.capacity() * sizeof(wildcard_listener) + m_dirty.capacity() * sizeof(uint32_t)
+				+ m_slots.capacity() * sizeof(slot) };
+			for (auto const& item : m_buckets)
+			{
+				total += item.listeners.capacity() * sizeof(key_listener);
+			}
+			return total;
+		}
+
+		//Pre-allocates room for the given number of keys, so subscribing to up to that many never has to grow the table.
+		void reserve_keys(size_t count)
+		{
+			m_buckets.reserve(count);
+			size_t size{ 16 };
+			while (size * 3 < count * 4)
+			{
+				size *= 2;
+			}
+			if (size > m_index.size())
+			{
+				rebuild_index(size);
+			}
+		}
+
+		//Name this delegate in instrumentation reports. Does nothing unless YADI_INSTRUMENTATION is on.
+		void set_name(std::string name)
+		{
+			m_stats.set_name(std::move(name));
+		}
+
+		//Force-removes all subscribers from this delegate immediately. Their handles are left harmless, see handle_anchor.
+		//If the delegate is executing, no more listeners will be called.
+		void clear_all_subscriptions()
+		{
+			for (auto& owner : m_buckets)
+			{
+				for (auto& item : owner.listeners)
+				{
+					if (!item.removed)
+					{
+						free_slot(item.slot);
+						item.removed = true;
+					}
+				}
+			}
+			for (auto& item : m_wildcard)
+			{
+				if (!item.removed)
+				{
+					free_slot(item.slot);
+					item.removed = true;
+				}
+			}
+			for (auto& item : m_pending)
+			{
+				if (!item.item.removed)
+				{
+					free_slot(item.item.slot);
+				}
+			}
+			for (auto& item : m_pendingWildcard)
+			{
+				if (!item.removed)
+				{
+					free_slot(item.slot);
+				}
+			}
+			m_pending.clear();
+			m_pendingWildcard.clear();
+
+			if (is_dispatching())
+			{
+				//the listeners may be running, so they are cleaned up afterwards
+				m_dirty.clear();
+				for (uint32_t id{ 0 }; id < m_buckets.size(); ++id)
+				{
+					m_buckets[id].dirty = true;
+					m_dirty.push_back(id);
+				}
+				m_wildcardDirty = true;
+			}
+			else
+			{
+				m_buckets.clear();
+				m_index.assign(m_index.size(), no_bucket);
+				m_wildcard.clear();
+			}
+		}
+	};
+}
+#endif
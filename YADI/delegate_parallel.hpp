@@ -0,0 +1,189 @@
+#ifndef YADI_DELEGATE_PARALLEL_H
+#define YADI_DELEGATE_PARALLEL_H
+/************************************************************************
+ delegate_parallel :
+	This contains yadi::worker_pool, a small fork-join thread pool that
+	yadi::delegate_fast::dispatch_parallel can spread listeners across.
+
+	- dispatch_parallel works with any executor that provides:
+	    size_t concurrency() const
+	      how many threads (including the caller) will run tasks
+	    void parallel_for(size_t count, F const& task)
+	      call task(0) ... task(count - 1), returning once all are done
+	  so you can plug in your engine's own job system instead.
+
+	- worker_pool hands out work one chunk at a time from a shared
+	  counter. Idle threads keep pulling chunks until none are left, so a
+	  thread stuck on a slow chunk doesn't hold everyone else up.
+
+	- The thread calling parallel_for works on chunks too, rather than
+	  sitting idle.
+
+	- Calling parallel_for from inside a task just runs the new tasks
+	  serially on that thread.
+
+*************************************************************************/
+
+#include "delegate_fast.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	class worker_pool
+	{
+	private:
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_submitLock;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		bool m_stopping{ false };
+		uint64_t m_generation{ 0 };
+		//number of threads currently working on the job. The job's details
+		//are only ever changed when this is zero.
+		size_t m_active{ 0 };
+
+		//the current job
+		void(*m_run)(void const*, size_t) { nullptr };
+		void const* m_context{ nullptr };
+		size_t m_count{ 0 };
+		std::atomic<size_t> m_next{ 0 };
+
+		static inline thread_local bool t_insideTask{ false };
+
+		void run_tasks()
+		{
+			size_t index;
+			while ((index = m_next.fetch_add(1, std::memory_order_relaxed)) < m_count)
+			{
+				m_run(m_context, index);
+			}
+		}
+
+		void worker_loop()
+		{
+			t_insideTask = true;
+			uint64_t seen{ 0 };
+
+			std::unique_lock<std::mutex> lock{ m_lock };
+			while (true)
+			{
+				m_wake.wait(lock, [this, &seen]() { return m_stopping || m_generation != seen; });
+				if (m_stopping)
+				{
+					return;
+				}
+				seen = m_generation;
+				++m_active;
+
+				lock.unlock();
+				run_tasks();
+				lock.lock();
+
+				if (--m_active == 0)
+				{
+					m_done.notify_all();
+				}
+			}
+		}
+
+	public:
+		//One less than the number of hardware threads, since the caller works too.
+		static size_t default_thread_count()
+		{
+			unsigned const hardware{ std::thread::hardware_concurrency() };
+			return hardware > 1 ? hardware - 1 : 0;
+		}
+
+		/*
+		* Params:
+		*	- thread_count
+		*		How many worker threads to start. The thread calling parallel_for also helps,
+		*		so the default leaves one hardware thread for it.
+		*/
+		explicit worker_pool(size_t thread_count = default_thread_count())
+		{
+			m_threads.reserve(thread_count);
+			for (size_t i{ 0 }; i < thread_count; ++i)
+			{
+				m_threads.emplace_back([this]() { worker_loop(); });
+			}
+		}
+
+		worker_pool(worker_pool const&) = delete;
+		worker_pool& operator=(worker_pool const&) = delete;
+
+		~worker_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock{ m_lock };
+				m_stopping = true;
+			}
+			m_wake.notify_all();
+			for (auto& thread : m_threads)
+			{
+				thread.join();
+			}
+		}
+
+		//Returns how many threads run tasks, including the one calling parallel_for.
+		size_t concurrency() const
+		{
+			return m_threads.size() + 1;
+		}
+
+		/*
+		* Call task(i) for every i in [0, count), spread across the pool, and
+		* return once every call has finished. Only one parallel_for runs at a time;
+		* other callers wait their turn.
+		*
+		* Params:
+		*	- count
+		*		How many tasks to run.
+		*	- task
+		*		The task to run. It will be called from several threads at once.
+		*/
+		template<typename F>
+		void parallel_for(size_t count, F const& task)
+		{
+			if (m_threads.empty() || count <= 1 || t_insideTask)
+			{
+				for (size_t i{ 0 }; i < count; ++i)
+				{
+					task(i);
+				}
+				return;
+			}
+
+			std::lock_guard<std::mutex> submit{ m_submitLock };
+			{
+				std::unique_lock<std::mutex> lock{ m_lock };
+				//a worker that woke up late for the last job may still be on its way out
+				m_done.wait(lock, [this]() { return m_active == 0; });
+
+				m_run = [](void const* context, size_t index) { (*static_cast<F const*>(context))(index); };
+				m_context = &task;
+				m_count = count;
+				m_next.store(0, std::memory_order_relaxed);
+				++m_generation;
+			}
+			m_wake.notify_all();
+
+			t_insideTask = true;
+			run_tasks();
+			t_insideTask = false;
+
+			//every task has been claimed, so once nobody is active, every task is finished
+			std::unique_lock<std::mutex> lock{ m_lock };
+			m_done.wait(lock, [this]() { return m_active == 0; });
+		}
+	};
+}
+#endif
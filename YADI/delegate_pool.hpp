@@ -0,0 +1,267 @@
+#ifndef YADI_DELEGATE_POOL_H
+#define YADI_DELEGATE_POOL_H
+/************************************************************************
+ delegate_pool :
+	This contains yadi::subscription_pool, a memory resource made for
+	handing to delegates (every delegate takes a std::pmr::memory_resource).
+
+	- Memory is handed out in fixed-size blocks, carved from big chunks
+	  taken from an upstream resource. Allocating and freeing a block is
+	  a free list push or pop: no searching, no locks, no fragmentation.
+
+	- Subscriptions to yadi::delegate are one map node each, which fits
+	  in a block with the default settings. Anything bigger or more
+	  strictly aligned than a block (growing arrays, for example) goes
+	  to the upstream resource, but the pool still keeps track of it.
+
+	- release() hands every chunk, and everything that went upstream,
+	  back at once. Give each subsystem its own pool, and throw the
+	  whole arena away when the subsystem goes.
+
+	- It is not thread-safe. Use one pool per thread, or only give it to
+	  delegates used from one thread at a time. A concurrent_delegate
+	  only touches its resource under its own lock, so it may have a
+	  pool to itself, but two of them must not share one (wrap it in a
+	  std::pmr::synchronized_pool_resource if they have to).
+
+*************************************************************************/
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+//see delegate_util.hpp
+#ifndef YADI_EXPORT
+#define YADI_EXPORT
+#endif
+
+//The default block size of a subscription_pool. It fits a yadi::delegate
+//subscription using the default YADI_INPLACE_FUNCTION_CAPACITY, on 64-bit targets.
+//With YADI_INSTRUMENTATION on, subscriptions need more like 512 bytes.
+#ifndef YADI_SUBSCRIPTION_POOL_BLOCK_SIZE
+#define YADI_SUBSCRIPTION_POOL_BLOCK_SIZE 128
+#endif
+
+YADI_EXPORT namespace yadi
+{
+	class subscription_pool : public std::pmr::memory_resource
+	{
+	private:
+		static constexpr size_t block_alignment{ alignof(std::max_align_t) };
+
+		//a freed block holds a pointer to the next free block
+		struct free_block
+		{
+			free_block* next;
+		};
+
+		//sits at the start of every chunk, followed by the blocks
+		struct chunk
+		{
+			chunk* next;
+			size_t bytes;
+		};
+
+		static constexpr size_t chunk_header_size{ (sizeof(chunk) + block_alignment - 1) / block_alignment * block_alignment };
+
+		//sits just before every allocation too big for a block, so release() can find them
+		struct large_allocation
+		{
+			large_allocation* previous;
+			large_allocation* next;
+			//what was asked of the pool
+			size_t bytes;
+			size_t alignment;
+		};
+
+		std::pmr::memory_resource* m_upstream;
+		size_t m_blockSize;
+		size_t m_blocksPerChunk;
+
+		free_block* m_free{ nullptr };
+		chunk* m_chunks{ nullptr };
+		large_allocation* m_large{ nullptr };
+		size_t m_blocksInUse{ 0 };
+
+		static size_t round_block_size(size_t bytes)
+		{
+			if (bytes < sizeof(free_block))
+			{
+				bytes = sizeof(free_block);
+			}
+			return (bytes + block_alignment - 1) / block_alignment * block_alignment;
+		}
+
+		bool fits_block(size_t bytes, size_t alignment) const
+		{
+			return bytes <= m_blockSize && alignment <= block_alignment;
+		}
+
+		void add_chunk()
+		{
+			size_t const bytes{ chunk_header_size + m_blockSize * m_blocksPerChunk };
+			auto* const memory{ static_cast<std::byte*>(m_upstream->allocate(bytes, block_alignment)) };
+
+			m_chunks = ::new (static_cast<void*>(memory)) chunk{ m_chunks, bytes };
+
+			//thread the new blocks onto the free list, first block first
+			std::byte* block{ memory + chunk_header_size + m_blockSize * m_blocksPerChunk };
+			while (block != memory + chunk_header_size)
+			{
+				block -= m_blockSize;
+				m_free = ::new (static_cast<void*>(block)) free_block{ m_free };
+			}
+		}
+
+		static size_t large_alignment(size_t alignment)
+		{
+			return alignment > block_alignment ? alignment : block_alignment;
+		}
+
+		//how far into its upstream memory a large allocation starts, leaving room for the header
+		static size_t large_offset(size_t alignment)
+		{
+			size_t const align{ large_alignment(alignment) };
+			return (sizeof(large_allocation) + align - 1) / align * align;
+		}
+
+		void* allocate_large(size_t bytes, size_t alignment)
+		{
+			size_t const offset{ large_offset(alignment) };
+			auto* const memory{ static_cast<std::byte*>(m_upstream->allocate(offset + bytes, large_alignment(alignment))) };
+			std::byte* const pointer{ memory + offset };
+
+			auto* const header{ ::new (static_cast<void*>(pointer - sizeof(large_allocation))) large_allocation{ nullptr, m_large, bytes, alignment } };
+			if (m_large)
+			{
+				m_large->previous = header;
+			}
+			m_large = header;
+			return pointer;
+		}
+
+		//expects header to already be off the list
+		void free_large(large_allocation* header)
+		{
+			size_t const offset{ large_offset(header->alignment) };
+			m_upstream->deallocate(reinterpret_cast<std::byte*>(header + 1) - offset, offset + header->bytes, large_alignment(header->alignment));
+		}
+
+		void deallocate_large(void* pointer)
+		{
+			auto* const header{ reinterpret_cast<large_allocation*>(static_cast<std::byte*>(pointer) - sizeof(large_allocation)) };
+			(header->previous ? header->previous->next : m_large) = header->next;
+			if (header->next)
+			{
+				header->next->previous = header->previous;
+			}
+			free_large(header);
+		}
+
+	protected:
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			if (!fits_block(bytes, alignment))
+			{
+				return allocate_large(bytes, alignment);
+			}
+
+			if (!m_free)
+			{
+				add_chunk();
+			}
+			free_block* const block{ m_free };
+			m_free = block->next;
+			++m_blocksInUse;
+			return block;
+		}
+
+		void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+		{
+			if (!fits_block(bytes, alignment))
+			{
+				deallocate_large(pointer);
+				return;
+			}
+
+			m_free = ::new (pointer) free_block{ m_free };
+			--m_blocksInUse;
+		}
+
+		bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+		{
+			return this == &other;
+		}
+
+	public:
+		/*
+		* Params:
+		*	- block_size
+		*		The size of every block. Allocations up to this size come from the pool.
+		*		Rounded up to a multiple of alignof(std::max_align_t).
+		*	- blocks_per_chunk
+		*		How many blocks to take from upstream whenever the pool runs dry.
+		*	- upstream
+		*		Where chunks, and allocations too big for a block, come from. It must outlive the pool.
+		*/
+		explicit subscription_pool(size_t block_size = YADI_SUBSCRIPTION_POOL_BLOCK_SIZE, size_t blocks_per_chunk = 256,
+			std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+			: m_upstream{ upstream },
+			m_blockSize{ round_block_size(block_size) },
+			m_blocksPerChunk{ blocks_per_chunk > 0 ? blocks_per_chunk : 1 }
+		{
+		}
+
+		subscription_pool(subscription_pool const&) = delete;
+		subscription_pool& operator=(subscription_pool const&) = delete;
+
+		~subscription_pool()
+		{
+			release();
+		}
+
+		/*
+		* Give every chunk, and every allocation too big for a block, back to the upstream
+		* resource at once, without waiting for any of it to be freed. Nothing may use memory
+		* from the pool afterwards, and that includes freeing it: destroy the delegates using
+		* the pool first, or let them go along with the rest of the arena without ever
+		* touching them again.
+		*/
+		void release()
+		{
+			while (m_large)
+			{
+				large_allocation* const current{ m_large };
+				m_large = current->next;
+				free_large(current);
+			}
+
+			while (m_chunks)
+			{
+				chunk const current{ *m_chunks };
+				m_upstream->deallocate(m_chunks, current.bytes, block_alignment);
+				m_chunks = current.next;
+			}
+			m_free = nullptr;
+			m_blocksInUse = 0;
+		}
+
+		//Returns the size of each block, after rounding.
+		size_t block_size() const
+		{
+			return m_blockSize;
+		}
+
+		//Returns how many blocks are currently handed out.
+		size_t blocks_in_use() const
+		{
+			return m_blocksInUse;
+		}
+
+		std::pmr::memory_resource* upstream_resource() const
+		{
+			return m_upstream;
+		}
+	};
+}
+#endif
@@ -0,0 +1,164 @@
+#ifndef YADI_DELEGATE_QUEUE_H
+#define YADI_DELEGATE_QUEUE_H
+/************************************************************************
+ delegate_queue :
+	This contains the functionality for the yadi::event_queue class.
+	yadi::event_queue has the following restrictions and features:
+
+	- It is a yadi::delegate, so subscribing, handles, and executing it
+	  immediately all work exactly the same.
+
+	- Additionally, post() records an event's arguments for later instead
+	  of calling listeners right away. drain() then delivers every
+	  recorded event, in the order they were posted.
+
+	- Arguments are copied when posted (references are stored as values),
+	  into a buffer that keeps its memory between drains. Once the buffer
+	  has grown to fit a typical frame, posting never allocates.
+
+	- In double_buffered mode, events posted while draining wait for the
+	  next drain(). In single_buffered mode, drain() keeps going until no
+	  events are left, so a listener that always posts never finishes.
+
+	- If none of the arguments are references, drain() hands the whole
+	  buffer to invoke_batch(), so batch listeners get every event in one
+	  call and listener_major delivery is available.
+
+*************************************************************************/
+
+#include "delegate.hpp"
+
+#include <memory_resource>
+#include <tuple>
+#include <vector>
+
+YADI_EXPORT namespace yadi
+{
+	enum class queue_mode
+	{
+		//events posted during drain() are delivered by that same drain()
+		single_buffered,
+		//events posted during drain() are delivered by the next drain()
+		double_buffered,
+	};
+
+	template<typename... Args>
+	class event_queue : public delegate<Args...>
+	{
+	private:
+		using event_type = std::tuple<std::decay_t<Args>...>;
+		//whether the stored events can be handed straight to invoke_batch()
+		static constexpr bool can_batch{ std::is_same_v<event_type, typename delegate<Args...>::argument_pack> };
+
+		std::pmr::vector<event_type> m_pending;
+		std::pmr::vector<event_type> m_draining;
+
+		queue_mode m_mode;
+		bool m_isDraining{ false };
+
+	public:
+		/*
+		* Params:
+		*	- mode
+		*		When events posted during drain() get delivered, see yadi::queue_mode.
+		*	- resource
+		*		Where to allocate subscriptions and the event buffers from (see subscription_pool in delegate_pool.hpp).
+		*		It must outlive the queue.
+		*/
+		explicit event_queue(queue_mode mode = queue_mode::double_buffered, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: delegate<Args...>{ resource }, m_pending{ resource }, m_draining{ resource }, m_mode{ mode }
+		{
+		}
+
+		/*
+		* Record an event, to be delivered to all listeners at the next drain().
+		*
+		* Params:
+		*	- args
+		*		The event's arguments. These are copied (or moved) into the queue.
+		*/
+		template<typename... Ts>
+		void post(Ts&&... args)
+		{
+			m_pending.emplace_back(std::forward<Ts>(args)...);
+		}
+
+		/*
+		* Deliver every posted event to every listener, in the order they were posted.
+		* Calling this from inside a listener while draining does nothing.
+		*
+		* Params:
+		*	- order
+		*		How to deliver the events, see yadi::batch_order. Only event_major is
+		*		available if any of the arguments are references.
+		*
+		* Returns:
+		*	The number of events delivered.
+		*/
+		size_t drain([[maybe_unused]] batch_order order = batch_order::event_major)
+		{
+			if (m_isDraining)
+			{
+				return 0;
+			}
+			m_isDraining = true;
+
+			size_t delivered{ 0 };
+			do
+			{
+				//anything posted from here on lands in the (now empty) other buffer
+				m_draining.swap(m_pending);
+				if constexpr (can_batch)
+				{
+					this->invoke_batch(m_draining, order);
+				}
+				else
+				{
+					//each event is delivered once, so it is handed over the way the signature asks (moved, for Args&&)
+					for (auto& event : m_draining)
+					{
+						std::apply([this](auto&... args) { (*this)(static_cast<util::param_t<Args>>(args)...); }, event);
+					}
+				}
+				delivered += m_draining.size();
+				m_draining.clear();
+			} while (m_mode == queue_mode::single_buffered && !m_pending.empty());
+
+			m_isDraining = false;
+			return delivered;
+		}
+
+		//Returns the number of events waiting for the next drain().
+		size_t pending_count() const
+		{
+			return m_pending.size();
+		}
+
+		//Returns roughly how many bytes this has allocated, on top of sizeof(event_queue): the subscriptions
+		//(see delegate::memory_usage) and both event buffers. Memory the events themselves point to isn't counted.
+		size_t memory_usage() const
+		{
+			return delegate<Args...>::memory_usage() + (m_pending.capacity() + m_draining.capacity()) * sizeof(event_type);
+		}
+
+		//Throw away every event waiting for the next drain().
+		void clear_pending()
+		{
+			m_pending.clear();
+		}
+
+		//Pre-allocates room for the given number of events per drain,
+		//so posting up to that many never has to grow the buffers.
+		void reserve(size_t count)
+		{
+			m_pending.reserve(count);
+			m_draining.reserve(count);
+		}
+
+		queue_mode mode() const
+		{
+			return m_mode;
+		}
+	};
+}
+#endif
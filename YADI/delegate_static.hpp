@@ -0,0 +1,175 @@
+#ifndef YADI_DELEGATE_STATIC_H
+#define YADI_DELEGATE_STATIC_H
+/************************************************************************
+ delegate_static :
+	This contains the functionality for the yadi::static_delegate class.
+	yadi::static_delegate has the following restrictions and features:
+
+	- Its listeners are fixed at compile time, as template arguments:
+	  static_delegate<listeners<&on_load, &Renderer::on_load>, Args...>
+	  Free functions, member functions, and captureless lambdas can all
+	  be listeners. They are called in the order they are listed.
+
+	- Executing it is a straight sequence of direct calls, which the
+	  compiler can inline and constant-fold like any other code. There
+	  is no storage for listeners, no handles, and nothing to allocate.
+
+	- Member function listeners need an instance, given to the
+	  constructor in the same order as the member functions are listed.
+	  Those instances must outlive the delegate.
+
+	- Calling it works exactly like yadi::delegate: arguments are shared
+	  between listeners as const references, only listeners that take
+	  them by value make a copy, and invoke_move_last() lets the last
+	  listener move from them. Swapping a static_delegate for a
+	  yadi::delegate (or back) doesn't change what listeners see.
+
+	- No return values are allowed for delegate listeners.
+
+*************************************************************************/
+
+#include "delegate_util.hpp"
+#include "delegate_instrumentation.hpp"
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+YADI_EXPORT namespace yadi
+{
+	//The listeners of a yadi::static_delegate, in the order they are called.
+	template<auto... Fns>
+	struct listeners {};
+
+	namespace util
+	{
+		//The class a member function pointer belongs to, or void for anything else.
+		template<typename F>
+		struct member_class
+		{
+			using type = void;
+		};
+
+		template<typename T, typename M>
+		struct member_class<M T::*>
+		{
+			using type = T;
+		};
+	}
+
+	template<typename Listeners, typename... Args>
+	class static_delegate;
+
+	template<auto... Fns, typename... Args>
+	class static_delegate<listeners<Fns...>, Args...>
+	{
+	private:
+		template<auto Fn>
+		static constexpr bool is_member{ std::is_member_function_pointer_v<decltype(Fn)> };
+
+		//what each listener is stored as: member functions need their instance, free functions need nothing
+		template<auto Fn>
+		using caller_type = std::conditional_t<is_member<Fn>,
+			util::member_caller<Fn, typename util::member_class<decltype(Fn)>::type>,
+			util::free_caller<Fn>>;
+
+		static_assert((std::is_invocable_v<caller_type<Fns> const&, Args...> && ...),
+			"yadi::static_delegate: a listener can't be called with this delegate's arguments.");
+
+		static constexpr size_t instance_count{ (size_t{ is_member<Fns> } + ... + 0) };
+
+		//which constructor argument is the instance for listener I
+		template<size_t I>
+		static constexpr size_t instance_index()
+		{
+			constexpr bool members[]{ is_member<Fns>..., false };
+			size_t index{ 0 };
+			for (size_t i{ 0 }; i < I; ++i)
+			{
+				index += members[i] ? 1 : 0;
+			}
+			return index;
+		}
+
+		template<auto Fn, size_t I, typename Instances>
+		static caller_type<Fn> make_caller([[maybe_unused]] Instances const& instances)
+		{
+			if constexpr (is_member<Fn>)
+			{
+				return caller_type<Fn>{ std::get<instance_index<I>()>(instances) };
+			}
+			else
+			{
+				return caller_type<Fn>{};
+			}
+		}
+
+		template<size_t... I, typename Instances>
+		static std::tuple<caller_type<Fns>...> make_callers(std::index_sequence<I...>, Instances const& instances)
+		{
+			return std::tuple<caller_type<Fns>...>{ make_caller<Fns, I>(instances)... };
+		}
+
+		//free function callers are empty, so only the instance pointers take up space
+		std::tuple<caller_type<Fns>...> m_callers;
+
+		//see delegate_instrumentation.hpp. Takes no space unless YADI_INSTRUMENTATION is on.
+		YADI_NO_UNIQUE_ADDRESS instrumentation::delegate_record m_stats;
+
+	public:
+		/*
+		* Params:
+		*	- instances
+		*		One pointer per member function listener, in the order they are listed. Free function
+		*		listeners don't take one. They must outlive the delegate.
+		*/
+		template<typename... Instances>
+			requires (sizeof...(Instances) == instance_count)
+		explicit static_delegate(Instances*... instances)
+			: m_callers{ make_callers(std::make_index_sequence<sizeof...(Fns)>{}, std::tuple<Instances*...>{ instances... }) }
+		{
+		}
+
+		//Execute the delegate, calling every listener in order.
+		//Arguments are passed to every listener as they are, without being copied or moved.
+		void operator()(util::param_t<Args>... args)
+		{
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+			std::apply([&args...](auto const&... callers)
+			{
+				(util::param_invoker<void, Args...>::call(callers, false, std::forward<util::param_t<Args>>(args)...), ...);
+			}, m_callers);
+		}
+
+		//Same as delegate::invoke_move_last: the last listener gets to move from arguments taken by value.
+		void invoke_move_last(Args... args)
+		{
+			[[maybe_unused]] auto const timer{ m_stats.time_dispatch() };
+			std::apply([&args...](auto const&... callers)
+			{
+				size_t called{ 0 };
+				(util::param_invoker<void, Args...>::call(callers, ++called == sizeof...(Fns), std::forward<util::param_t<Args>>(args)...), ...);
+			}, m_callers);
+		}
+
+		//Returns the number of listeners, which never changes.
+		static constexpr size_t subscriber_count()
+		{
+			return sizeof...(Fns);
+		}
+
+		//Returns the bytes this delegate has allocated, which is always none.
+		static constexpr size_t memory_usage()
+		{
+			return 0;
+		}
+
+		//Name this delegate in instrumentation reports. Does nothing unless YADI_INSTRUMENTATION is on.
+		void set_name(std::string name)
+		{
+			m_stats.set_name(std::move(name));
+		}
+	};
+}
+#endif
@@ -1,38 +1,539 @@
+#ifndef YADI_DELEGATE_UTIL_H
+#define YADI_DELEGATE_UTIL_H
 /********************************************************************************
  delegate_util:
 	This contains some functionality that's useful for different parts of YADI.
 	You might some of these functions useful, too.
 *********************************************************************************/
 
-#include <functional>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
 
-namespace yadi
+//The number of bytes an inplace_function can hold without being told otherwise.
+//The default fits a member function pointer plus an instance pointer, or a lambda
+//capturing up to four pointers. Define this before including YADI to change it.
+#ifndef YADI_INPLACE_FUNCTION_CAPACITY
+#define YADI_INPLACE_FUNCTION_CAPACITY (4 * sizeof(void*))
+#endif
+
+//Goes in front of each of YADI's namespaces. yadi.cppm defines it as export, which builds
+//the yadi module (import yadi;) out of these same headers. Leave it alone otherwise.
+#ifndef YADI_EXPORT
+#define YADI_EXPORT
+#endif
+
+YADI_EXPORT namespace yadi
 {
 	namespace util
 	{
-		/* Performs type-erasure on a class member function and returns an std::function
+		/* How an argument of type T is passed to a callback that shares it with other callbacks.
+		*  Arguments taken by value are passed as const references, so nobody copies them unless
+		*  they ask for their own copy. References are passed as they are.
+		*/
+		template<typename T>
+		using param_t = std::conditional_t<std::is_reference_v<T>, T, T const&>;
+
+		/* How each listener sharing an argument of type T actually sees it. Same as param_t,
+		*  except that rvalue references are seen as const references too: the first listener
+		*  to take one by value would otherwise move it away from all the others.
+		*/
+		template<typename T>
+		using shared_t = std::conditional_t<std::is_rvalue_reference_v<T>, std::remove_reference_t<T> const&, param_t<T>>;
+
+		/* Turns a param_t<T> back into a T&&, so an argument taken by value can be moved from.
+		*  Only do this to the last user of the argument, and only if it refers to something
+		*  that isn't really const.
+		*/
+		template<typename T>
+		T&& take_param(param_t<T>& arg)
+		{
+			return static_cast<T&&>(const_cast<std::remove_reference_t<T>&>(arg));
+		}
+
+		/* Makes a listener its own copy of an argument it can't accept as a shared_t<T>
+		*  (for example, because it takes T&&). Lvalue references are passed as they are.
+		*/
+		template<typename T>
+		decltype(auto) copy_param(param_t<T>& arg)
+		{
+			if constexpr (std::is_lvalue_reference_v<T>)
+			{
+				return static_cast<T>(arg);
+			}
+			else
+			{
+				return std::remove_cvref_t<T>(std::as_const(arg));
+			}
+		}
+
+		/* Calls a callback with the signature Ret(Args...) using param_t arguments.
+		*  If consume is true, arguments taken by value or by rvalue reference are moved into the callback.
+		*  Otherwise, the callback gets them as const references, or gets its own copy
+		*  if it can't accept a const reference (for example, if it takes T&&).
+		*/
+		template<typename Ret, typename... Args>
+		struct param_invoker
+		{
+			template<typename F>
+			static Ret call(F& fn, [[maybe_unused]] bool consume, param_t<Args>... args)
+			{
+				if constexpr ((!std::is_lvalue_reference_v<Args> || ...))
+				{
+					if (consume)
+					{
+						return fn(take_param<Args>(args)...);
+					}
+				}
+
+				if constexpr (std::is_invocable_v<F&, shared_t<Args>...>)
+				{
+					return fn(static_cast<shared_t<Args>>(args)...);
+				}
+				else
+				{
+					return fn(copy_param<Args>(args)...);
+				}
+			}
+		};
+
+		//Calls the member function Fn on an instance, with whatever arguments it's given.
+		//Fn is known at compile time, so the call to it gets inlined.
+		template<auto Fn, typename T>
+		struct member_caller
+		{
+			T* instance;
+
+			template<typename... Ts>
+				requires std::is_invocable_v<decltype(Fn), T*, Ts...>
+			decltype(auto) operator()(Ts&&... args) const
+			{
+				return (instance->*Fn)(std::forward<Ts>(args)...);
+			}
+		};
+
+		//Calls the free function Fn with whatever arguments it's given.
+		//Fn is known at compile time, so the call to it gets inlined.
+		template<auto Fn>
+		struct free_caller
+		{
+			template<typename... Ts>
+				requires std::is_invocable_v<decltype(Fn), Ts...>
+			decltype(auto) operator()(Ts&&... args) const
+			{
+				return Fn(std::forward<Ts>(args)...);
+			}
+		};
+
+		template<typename Signature, size_t Capacity = YADI_INPLACE_FUNCTION_CAPACITY, size_t Alignment = alignof(std::max_align_t)>
+		class inplace_function;
+
+		/* A replacement for std::function that never allocates.
+		*  The callable is stored directly inside the object, in a buffer of Capacity bytes.
+		*  Trying to store a callable that doesn't fit is a compile error, not a heap allocation.
+		*
+		*  Calling an inplace_function is a single indirect call, straight into code
+		*  generated for the stored callable's type.
+		*
+		*  call_shared() passes arguments taken by value as const references, so the same arguments
+		*  can be handed to many inplace_functions without being copied for each one.
+		*
+		*  Calling an empty inplace_function is undefined behavior. Check it with operator bool first
+		*  if you aren't sure.
+		*
+		*  Template params:
+		*	- Signature
+		*		The function signature, such as void(int).
+		*	- Capacity
+		*		How many bytes of storage are available for the callable.
+		*	- Alignment
+		*		The strictest alignment a stored callable may have.
+		*/
+		template<typename Ret, typename... Args, size_t Capacity, size_t Alignment>
+		class inplace_function<Ret(Args...), Capacity, Alignment>
+		{
+		private:
+			using invoke_type = Ret(*)(void*, bool, param_t<Args>...);
+
+			enum class operation { copy, move, destroy };
+			//copy/move/destroy the callable. Left as nullptr for trivially-copyable callables,
+			//in which case copying the storage bytes is all that's needed.
+			using manage_type = void(*)(operation, void*, void*);
+
+			invoke_type m_invoke{ nullptr };
+			manage_type m_manage{ nullptr };
+			alignas(Alignment) mutable unsigned char m_storage[Capacity];
+
+			template<typename F>
+			static Ret invoke(void* storage, bool consume, param_t<Args>... args)
+			{
+				return param_invoker<Ret, Args...>::call(*static_cast<F*>(storage), consume, std::forward<param_t<Args>>(args)...);
+			}
+
+			template<typename F>
+			static void manage(operation op, void* destination, void* source)
+			{
+				switch (op)
+				{
+				case operation::copy:
+					::new (destination) F(*static_cast<F const*>(source));
+					break;
+				case operation::move:
+					::new (destination) F(std::move(*static_cast<F*>(source)));
+					static_cast<F*>(source)->~F();
+					break;
+				case operation::destroy:
+					static_cast<F*>(destination)->~F();
+					break;
+				}
+			}
+
+			template<typename F>
+			static constexpr bool is_nullable{ std::is_pointer_v<F> || std::is_member_pointer_v<F> };
+
+			//these expect this to be empty
+			void copy_from(inplace_function const& other)
+			{
+				m_invoke = other.m_invoke;
+				m_manage = other.m_manage;
+				if (m_manage)
+				{
+					m_manage(operation::copy, m_storage, other.m_storage);
+				}
+				else if (m_invoke)
+				{
+					std::memcpy(m_storage, other.m_storage, Capacity);
+				}
+			}
+
+			void move_from(inplace_function& other)
+			{
+				m_invoke = other.m_invoke;
+				m_manage = other.m_manage;
+				if (m_manage)
+				{
+					m_manage(operation::move, m_storage, other.m_storage);
+				}
+				else if (m_invoke)
+				{
+					std::memcpy(m_storage, other.m_storage, Capacity);
+				}
+				other.m_invoke = nullptr;
+				other.m_manage = nullptr;
+			}
+
+		public:
+			inplace_function() = default;
+
+			inplace_function(std::nullptr_t) {}
+
+			/*
+			* Store any callable object (lambda, function pointer, functor, etc).
+			*
+			* Params:
+			*	- fn
+			*		The callable to store. It must be invocable as Ret(Args...), and must fit in Capacity bytes.
+			*/
+			template<typename F, typename = std::enable_if_t<
+				!std::is_same_v<std::decay_t<F>, inplace_function> &&
+				std::is_invocable_r_v<Ret, std::decay_t<F>&, Args...>>>
+			inplace_function(F&& fn)
+			{
+				using functor = std::decay_t<F>;
+				static_assert(sizeof(functor) <= Capacity,
+					"yadi::util::inplace_function: callable is too large for the buffer. Capture less, or raise the Capacity (see YADI_INPLACE_FUNCTION_CAPACITY).");
+				static_assert(Alignment % alignof(functor) == 0,
+					"yadi::util::inplace_function: callable needs stricter alignment than the buffer provides.");
+
+				if constexpr (is_nullable<functor>)
+				{
+					if (fn == nullptr)
+					{
+						return;
+					}
+				}
+
+				::new (static_cast<void*>(m_storage)) functor(std::forward<F>(fn));
+				m_invoke = &invoke<functor>;
+				if constexpr (!std::is_trivially_copyable_v<functor>)
+				{
+					m_manage = &manage<functor>;
+				}
+				else if constexpr (sizeof(functor) < Capacity)
+				{
+					//copies memcpy the whole buffer, so don't leave any of it uninitialized
+					std::memset(m_storage + sizeof(functor), 0, Capacity - sizeof(functor));
+				}
+			}
+
+			inplace_function(inplace_function const& other)
+			{
+				copy_from(other);
+			}
+
+			inplace_function(inplace_function&& other) noexcept
+			{
+				move_from(other);
+			}
+
+			inplace_function& operator=(inplace_function const& other)
+			{
+				if (this != &other)
+				{
+					reset();
+					copy_from(other);
+				}
+				return *this;
+			}
+
+			inplace_function& operator=(inplace_function&& other) noexcept
+			{
+				if (this != &other)
+				{
+					reset();
+					move_from(other);
+				}
+				return *this;
+			}
+
+			inplace_function& operator=(std::nullptr_t)
+			{
+				reset();
+				return *this;
+			}
+
+			~inplace_function()
+			{
+				reset();
+			}
+
+			//Destroy the stored callable, leaving this empty.
+			void reset()
+			{
+				if (m_manage)
+				{
+					m_manage(operation::destroy, m_storage, nullptr);
+				}
+				m_invoke = nullptr;
+				m_manage = nullptr;
+			}
+
+			//Call the stored callable. This must not be empty.
+			Ret operator()(Args... args) const
+			{
+				return m_invoke(m_storage, true, std::forward<Args>(args)...);
+			}
+
+			//Call the stored callable without copying or moving any arguments.
+			//Callables that take arguments by value make their own copy. This must not be empty.
+			Ret call_shared(param_t<Args>... args) const
+			{
+				return m_invoke(m_storage, false, std::forward<param_t<Args>>(args)...);
+			}
+
+			//Call the stored callable, letting it move from arguments taken by value.
+			//They must refer to objects that aren't really const, and that nobody needs afterwards.
+			//This must not be empty.
+			Ret call_consuming(param_t<Args>... args) const
+			{
+				return m_invoke(m_storage, true, std::forward<param_t<Args>>(args)...);
+			}
+
+			//Returns true if a callable is stored.
+			explicit operator bool() const
+			{
+				return m_invoke != nullptr;
+			}
+		};
+
+		//Roughly what one element of a node-based container (std::map, std::unordered_map) costs:
+		//the element itself, plus the links and bookkeeping standard libraries keep next to it.
+		template<typename T>
+		inline constexpr size_t node_size{ sizeof(T) + 4 * sizeof(void*) };
+
+		template<typename Signature>
+		class bound_function;
+
+		/* The smallest possible type-erased callback: an instance pointer and a function pointer.
+		*  The target function is a template parameter, so it is known at compile time and gets
+		*  inlined into a generated thunk. Calling a bound_function is one indirect call, and
+		*  there's no member function pointer to decode at runtime.
+		*
+		*  Use bind<&Coffee::Brew>(instance) for member functions and bind<&brew_coffee>() for free functions.
+		*  The instance is not owned; it must outlive the bound_function.
+		*/
+		template<typename Ret, typename... Args>
+		class bound_function<Ret(Args...)>
+		{
+		private:
+			using thunk_type = Ret(*)(void*, bool, param_t<Args>...);
+
+			void* m_instance{ nullptr };
+			thunk_type m_thunk{ nullptr };
+
+			template<auto Fn, typename T>
+			static Ret member_thunk(void* instance, bool consume, param_t<Args>... args)
+			{
+				member_caller<Fn, T> const caller{ static_cast<T*>(instance) };
+				return param_invoker<Ret, Args...>::call(caller, consume, std::forward<param_t<Args>>(args)...);
+			}
+
+			template<auto Fn>
+			static Ret free_thunk(void*, bool consume, param_t<Args>... args)
+			{
+				free_caller<Fn> const caller;
+				return param_invoker<Ret, Args...>::call(caller, consume, std::forward<param_t<Args>>(args)...);
+			}
+
+			//the callable's bytes are kept in place of the instance pointer, see bind_small
+			template<typename F>
+			static Ret small_thunk(void* storage, bool consume, param_t<Args>... args)
+			{
+				alignas(F) unsigned char bytes[sizeof(F)];
+				std::memcpy(bytes, &storage, sizeof(F));
+				F const& callable{ *std::launder(reinterpret_cast<F const*>(bytes)) };
+				return param_invoker<Ret, Args...>::call(callable, consume, std::forward<param_t<Args>>(args)...);
+			}
+
+		public:
+			bound_function() = default;
+
+			/*
+			* Bind a member function, known at compile time, to an instance.
+			*
+			* Template params:
+			*	- Fn
+			*		The member function to call (&Coffee::Brew).
+			*
+			* Params:
+			*	- instance
+			*		A pointer to the object to call the function on.
+			*
+			* Returns:
+			*	A bound_function that, if run, is equivalent to doing instance->Fn().
+			*/
+			template<auto Fn, typename T>
+			static bound_function bind(T* instance)
+			{
+				static_assert(std::is_member_function_pointer_v<decltype(Fn)>,
+					"yadi::util::bound_function: Fn must be a member function pointer when binding an instance.");
+				static_assert(std::is_invocable_r_v<Ret, decltype(Fn), T*, Args...>,
+					"yadi::util::bound_function: Fn can't be called on this instance with this signature.");
+
+				bound_function result;
+				result.m_instance = const_cast<void*>(static_cast<void const*>(instance));
+				result.m_thunk = &member_thunk<Fn, T>;
+				return result;
+			}
+
+			/*
+			* Bind a free function (or static member function), known at compile time.
+			*
+			* Template params:
+			*	- Fn
+			*		The function to call (&brew_coffee).
+			*
+			* Returns:
+			*	A bound_function that, if run, is equivalent to doing Fn().
+			*/
+			template<auto Fn>
+			static bound_function bind()
+			{
+				static_assert(std::is_invocable_r_v<Ret, decltype(Fn), Args...>,
+					"yadi::util::bound_function: Fn can't be called with this signature.");
+
+				bound_function result;
+				result.m_thunk = &free_thunk<Fn>;
+				return result;
+			}
+
+			//Whether bind_small can store a callable of type F: it must be trivially copyable and
+			//no bigger than a pointer. Function pointers, and lambdas capturing one pointer or reference, are.
+			template<typename F>
+			static constexpr bool fits_small{ std::is_trivially_copyable_v<F> && sizeof(F) <= sizeof(void*) && alignof(F) <= alignof(void*) };
+
+			/*
+			* Bind a callable that's known only at runtime, but small enough to keep in place of the
+			* instance pointer (see fits_small): a function pointer, or a lambda capturing one pointer.
+			*
+			* Params:
+			*	- fn
+			*		The callable. A copy of it is kept. Null function pointers make an empty bound_function.
+			*
+			* Returns:
+			*	A bound_function that, if run, is equivalent to doing fn().
+			*/
+			template<typename F>
+			static bound_function bind_small(F fn)
+			{
+				static_assert(fits_small<F>, "yadi::util::bound_function: the callable must be trivially copyable, and no bigger than a pointer.");
+				static_assert(std::is_invocable_r_v<Ret, F const&, Args...>, "yadi::util::bound_function: fn can't be called with this signature.");
+
+				bound_function result;
+				if constexpr (std::is_pointer_v<F>)
+				{
+					if (!fn)
+					{
+						return result;
+					}
+				}
+				std::memcpy(&result.m_instance, &fn, sizeof(F));
+				result.m_thunk = &small_thunk<F>;
+				return result;
+			}
+
+			//Call the bound function. This must not be empty.
+			Ret operator()(Args... args) const
+			{
+				return m_thunk(m_instance, true, std::forward<Args>(args)...);
+			}
+
+			//Same as inplace_function::call_shared.
+			Ret call_shared(param_t<Args>... args) const
+			{
+				return m_thunk(m_instance, false, std::forward<param_t<Args>>(args)...);
+			}
+
+			//Same as inplace_function::call_consuming.
+			Ret call_consuming(param_t<Args>... args) const
+			{
+				return m_thunk(m_instance, true, std::forward<param_t<Args>>(args)...);
+			}
+
+			//Returns true if a function is bound.
+			explicit operator bool() const
+			{
+				return m_thunk != nullptr;
+			}
+		};
+
+		/* Performs type-erasure on a class member function and returns an inplace_function
 		*  with the same signature, bound to the given instance.
-		* 
+		*
 		*  Params:
 		*	- func
 		*		The member function we should bind.
 		*	- instance
 		*		A pointer to the instance of the class to bind the function to.
-		* 
+		*
 		*  Returns:
-		*		An std::function that, if run, is equivalent to doing instance->func().
+		*		An inplace_function that, if run, is equivalent to doing instance->func().
 		*/
 		template<typename Ret_type, typename Src_type, typename Inst, typename... Args>
-		std::function<Ret_type(Args...)> attach(Ret_type(Src_type::* func)(Args...), Inst* instance)
+		inplace_function<Ret_type(Args...)> attach(Ret_type(Src_type::* func)(Args...), Inst* instance)
 		{
-			auto boundFunction{ [instance, func](Args... args)->Ret_type
+			//takes whatever it's given, so shared arguments reach func without an extra copy
+			auto boundFunction{ [instance, func]<typename... Ts>(Ts&&... args) -> Ret_type
+				requires std::is_invocable_v<Ret_type(Src_type::*)(Args...), Inst*, Ts...>
 				{
-					return (instance->*func)(args...);
+					return (instance->*func)(std::forward<Ts>(args)...);
 				} };
 			return boundFunction;
 		}
 
-		/* Performs type-erasure on a class member function and returns an std::function
+		/* Performs type-erasure on a class member function and returns an inplace_function
 		*  with the same signature, bound to the given instance.
 		*
 		*  Params:
@@ -40,14 +541,15 @@ namespace yadi
 		*		The member function we should bind.
 		*	- instance
 		*		A reference to the instance of the class to bind the function to.
-		* 
+		*
 		*	Returns:
-		*		An std::function that, if run, is equivalent to doing instance.func().
+		*		An inplace_function that, if run, is equivalent to doing instance.func().
 		*/
 		template<typename Ret_type, typename Src_type, typename Inst, typename... Args>
-		std::function<Ret_type(Args...)> attach(Ret_type(Src_type::* func)(Args...), Inst& instance)
+		inplace_function<Ret_type(Args...)> attach(Ret_type(Src_type::* func)(Args...), Inst& instance)
 		{
 			return attach(func, &instance);
 		}
 	}
-}
\ No newline at end of file
+}
+#endif
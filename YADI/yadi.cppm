@@ -0,0 +1,68 @@
+/************************************************************************
+ yadi.cppm :
+	The C++20 module interface for YADI. Build this once and import yadi;
+	instead of including the headers, so the standard headers and the
+	delegates behind them are only parsed once for the whole program.
+
+	- It is made from the same headers, so both can be mixed freely in
+	  one program (but not in one file).
+
+	- Macros don't travel through modules. Configuration macros such as
+	  YADI_INSTRUMENTATION or YADI_INPLACE_FUNCTION_CAPACITY must be set
+	  when building this file, and YADI_EXTERN_DELEGATE and friends still
+	  need the headers.
+
+	- With CMake 3.28 or newer, set YADI_BUILD_MODULE and link against
+	  yadi::module.
+
+*************************************************************************/
+
+module;
+
+//everything the headers include, so the standard library stays outside the module
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+export module yadi;
+
+#define YADI_EXPORT export
+
+#include "delegate.hpp"
+#include "delegate_fast.hpp"
+#include "delegate_interruptible.hpp"
+#include "delegate_concurrent.hpp"
+#include "delegate_parallel.hpp"
+#include "delegate_queue.hpp"
+#include "delegate_group.hpp"
+#include "delegate_pool.hpp"
+#include "delegate_static.hpp"
+#include "delegate_bus.hpp"
+#include "delegate_channel.hpp"
+#include "delegate_intrusive.hpp"
+#include "delegate_keyed.hpp"
+#include "delegate_coalescing.hpp"
+#include "delegate_affinity.hpp"
+#include "delegate_compact.hpp"
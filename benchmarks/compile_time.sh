@@ -0,0 +1,113 @@
+#!/bin/sh
+# Measures how long it takes to compile many files that all use the same delegate signatures,
+# the usual way and with those signatures instantiated once (YADI_EXTERN_DELEGATE).
+#
+#   benchmarks/compile_time.sh [files] [compiler flags...]
+#
+# Set CXX to pick the compiler (default c++). Set MODULE=1 to also time import yadi;
+# which needs a compiler that can build and import the module (see YADI/yadi.cppm).
+
+set -e
+
+files=${1:-32}
+[ $# -gt 0 ] && shift
+flags=${*:--O2}
+cxx=${CXX:-c++}
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# One file's worth of typical delegate use: every common signature, with both delegates.
+body='
+namespace
+{
+	struct listener
+	{
+		int total{ 0 };
+		void on_int(int value) { total += value; }
+		void on_float(float value) { total += static_cast<int>(value); }
+		void on_bool(bool value) { total += value ? 1 : 0; }
+		void on_nothing() { ++total; }
+	};
+}
+
+int use_delegates(int seed)
+{
+	listener item;
+	yadi::delegate<int> ints;
+	yadi::delegate<float> floats;
+	yadi::delegate<bool> bools;
+	yadi::delegate<> nothing;
+	yadi::delegate_fast<int> fast_ints;
+	yadi::delegate_fast<> fast_nothing;
+
+	yadi::delegate_handle handles[]{
+		ints.subscribe(&listener::on_int, &item),
+		floats.subscribe<&listener::on_float>(&item),
+		bools.subscribe([&item](bool value) { item.on_bool(value); }),
+		nothing.subscribe(&listener::on_nothing, &item),
+		fast_ints.subscribe<&listener::on_int>(&item),
+		fast_nothing.subscribe([&item]() { item.on_nothing(); }),
+	};
+
+	ints(seed);
+	floats(1.5f);
+	bools(true);
+	nothing();
+	fast_ints(seed);
+	fast_nothing();
+	handles[0].unsubscribe();
+	return item.total + static_cast<int>(ints.subscriber_count() + fast_ints.subscriber_count());
+}
+'
+
+# make_files <directory> <text before each file's body> [text for an extra file]
+make_files()
+{
+	mkdir -p "$1"
+	i=0
+	while [ "$i" -lt "$files" ]; do
+		printf '%s\n%s\n' "$2" "$body" | sed "s/use_delegates/use_delegates_$i/" > "$1/file_$i.cpp"
+		i=$((i + 1))
+	done
+	if [ -n "$3" ]; then
+		printf '%s\n' "$3" > "$1/instantiate.cpp"
+	fi
+}
+
+# time_build <directory> <extra flags>: compiles every file in the directory, one at a time
+time_build()
+{
+	start=$(date +%s.%N)
+	for source in "$1"/*.cpp; do
+		# shellcheck disable=SC2086
+		$cxx -std=c++20 $flags $2 -I"$root" -c "$source" -o "${source%.cpp}.o"
+	done
+	end=$(date +%s.%N)
+	echo "$start $end" | awk '{ printf "%.2f", $2 - $1 }'
+}
+
+includes='#include <YADI/delegate.hpp>
+#include <YADI/delegate_fast.hpp>'
+
+make_files "$work/plain" "$includes"
+make_files "$work/extern" "$includes
+YADI_COMMON_SIGNATURES(YADI_EXTERN_DELEGATE);
+YADI_COMMON_SIGNATURES(YADI_EXTERN_DELEGATE_FAST);" "$includes
+YADI_COMMON_SIGNATURES(YADI_INSTANTIATE_DELEGATE);
+YADI_COMMON_SIGNATURES(YADI_INSTANTIATE_DELEGATE_FAST);"
+
+echo "Compiling $files files with $cxx $flags"
+echo "  plain headers:                  $(time_build "$work/plain" "")s"
+echo "  YADI_EXTERN_DELEGATE (+1 file): $(time_build "$work/extern" "")s"
+
+if [ "${MODULE:-0}" = "1" ]; then
+	# <new> is for older GCCs, which don't find placement new through the module
+	make_files "$work/module" "#include <new>
+import yadi;"
+	cp "$root/YADI/yadi.cppm" "$work/module/yadi.cpp"
+	sed -i 's|#include "delegate|#include "YADI/delegate|' "$work/module/yadi.cpp"
+	# the module has to be built before anything imports it, so its name sorts first
+	mv "$work/module/yadi.cpp" "$work/module/0_yadi.cpp"
+	(cd "$work/module" && echo "  import yadi (+1 file):           $(time_build "$work/module" "-fmodules-ts")s")
+fi
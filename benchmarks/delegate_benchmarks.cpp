@@ -0,0 +1,457 @@
+/*********************************************************************************************
+
+	Benchmarks for the cost of the basic delegate operations, at several listener counts,
+	for each way of storing listeners.
+
+	Every number is the average time for one operation, in nanoseconds, except memory,
+	which is bytes per subscription. Build in release mode (the default for this target,
+	see CMakeLists.txt) before reading anything into the results.
+
+	The two baselines are what you'd write by hand without a delegate library:
+		- std::vector<std::function>: unsubscribing swaps the last callback into the removed
+		  one's place, by index. There are no handles to move.
+		- function pointer array: the same, but only free functions can be stored.
+	They don't manage subscription lifetimes at all, so they're the floor to measure against.
+
+	Pass "quick" as the first argument for a much shorter (and noisier) run.
+
+**********************************************************************************************/
+
+#include "../YADI/delegate.hpp"
+#include "../YADI/delegate_fast.hpp"
+#include "../YADI/delegate_group.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace yadi
+{
+	namespace benchmarks
+	{
+		//everything the listeners do ends up here, so none of the work can be optimized away
+		//(unsigned, so it can wrap around safely)
+		unsigned g_sink{ 0 };
+
+		void free_listener(int a)
+		{
+			g_sink += static_cast<unsigned>(a);
+		}
+
+		struct listener_object
+		{
+			int total{ 0 };
+
+			void on_event(int a)
+			{
+				total += a;
+				g_sink += static_cast<unsigned>(a);
+			}
+		};
+
+		/*
+		* A memory resource that keeps count of how many bytes are allocated through it
+		* and passes everything on to the default resource.
+		*/
+		class counting_resource : public std::pmr::memory_resource
+		{
+		private:
+			size_t m_bytes{ 0 };
+
+			void* do_allocate(size_t bytes, size_t alignment) override
+			{
+				m_bytes += bytes;
+				return std::pmr::get_default_resource()->allocate(bytes, alignment);
+			}
+
+			void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+			{
+				m_bytes -= bytes;
+				std::pmr::get_default_resource()->deallocate(pointer, bytes, alignment);
+			}
+
+			bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+			{
+				return this == &other;
+			}
+
+		public:
+			size_t bytes() const
+			{
+				return m_bytes;
+			}
+		};
+
+		/* Listener storage strategies.
+		*  Each one provides:
+		*	- name
+		*	- has_handles: whether move_handles() means anything
+		*	- a constructor taking the memory resource to allocate from
+		*	- subscribe(listener_object&), unsubscribe_all(), dispatch(int), move_handles()
+		*	- handle_bytes(): memory used outside of the memory resource, for the handles
+		*/
+
+		struct function_vector
+		{
+			static constexpr char const* name{ "std::vector<std::function>" };
+			static constexpr bool has_handles{ false };
+
+			std::pmr::vector<std::function<void(int)>> callbacks;
+
+			explicit function_vector(std::pmr::memory_resource* resource)
+				: callbacks{ resource }
+			{
+			}
+
+			void subscribe(listener_object& object)
+			{
+				callbacks.push_back([&object](int a) { object.on_event(a); });
+			}
+
+			void unsubscribe_all()
+			{
+				while (!callbacks.empty())
+				{
+					callbacks.front() = std::move(callbacks.back());
+					callbacks.pop_back();
+				}
+			}
+
+			void dispatch(int a)
+			{
+				for (auto& callback : callbacks)
+				{
+					callback(a);
+				}
+			}
+
+			void move_handles() {}
+
+			size_t handle_bytes() const
+			{
+				return 0;
+			}
+		};
+
+		struct pointer_array
+		{
+			static constexpr char const* name{ "function pointer array" };
+			static constexpr bool has_handles{ false };
+
+			std::pmr::vector<void(*)(int)> callbacks;
+
+			explicit pointer_array(std::pmr::memory_resource* resource)
+				: callbacks{ resource }
+			{
+			}
+
+			void subscribe(listener_object&)
+			{
+				callbacks.push_back(&free_listener);
+			}
+
+			void unsubscribe_all()
+			{
+				while (!callbacks.empty())
+				{
+					callbacks.front() = callbacks.back();
+					callbacks.pop_back();
+				}
+			}
+
+			void dispatch(int a)
+			{
+				for (auto callback : callbacks)
+				{
+					callback(a);
+				}
+			}
+
+			void move_handles() {}
+
+			size_t handle_bytes() const
+			{
+				return 0;
+			}
+		};
+
+		//how a delegate strategy subscribes its listeners
+		enum class subscribe_kind
+		{
+			//subscribe(&listener_object::on_event, &object), which goes through util::attach
+			attach,
+			//subscribe<&listener_object::on_event>(&object)
+			bound,
+			//subscribe([&object](int a) { ... })
+			lambda,
+		};
+
+		template<typename Delegate, subscribe_kind Kind>
+		struct delegate_strategy
+		{
+			static constexpr bool has_handles{ true };
+
+			//declared before the handles, so the handles go first
+			Delegate target;
+			std::vector<delegate_handle> handles;
+
+			explicit delegate_strategy(std::pmr::memory_resource* resource)
+				: target{ resource }
+			{
+			}
+
+			void subscribe(listener_object& object)
+			{
+				if constexpr (Kind == subscribe_kind::attach)
+				{
+					handles.push_back(target.subscribe(&listener_object::on_event, &object));
+				}
+				else if constexpr (Kind == subscribe_kind::bound)
+				{
+					handles.push_back(target.template subscribe<&listener_object::on_event>(&object));
+				}
+				else
+				{
+					handles.push_back(target.subscribe([&object](int a) { object.on_event(a); }));
+				}
+			}
+
+			void unsubscribe_all()
+			{
+				handles.clear();
+			}
+
+			void dispatch(int a)
+			{
+				target(a);
+			}
+
+			//what happens to every handle when a std::vector of components reallocates
+			void move_handles()
+			{
+				std::vector<delegate_handle> moved;
+				moved.reserve(handles.capacity() * 2);
+				for (auto& handle : handles)
+				{
+					moved.push_back(std::move(handle));
+				}
+				handles.swap(moved);
+			}
+
+			size_t handle_bytes() const
+			{
+				return handles.size() * sizeof(delegate_handle);
+			}
+		};
+
+		//Same as delegate_strategy, but the handles live in a subscription_group.
+		template<typename Delegate>
+		struct grouped_strategy
+		{
+			static constexpr bool has_handles{ false };
+
+			Delegate target;
+			subscription_group group;
+
+			explicit grouped_strategy(std::pmr::memory_resource* resource)
+				: target{ resource }
+			{
+			}
+
+			void subscribe(listener_object& object)
+			{
+				group += target.subscribe([&object](int a) { object.on_event(a); });
+			}
+
+			void unsubscribe_all()
+			{
+				group.clear();
+			}
+
+			void dispatch(int a)
+			{
+				target(a);
+			}
+
+			void move_handles() {}
+
+			size_t handle_bytes() const
+			{
+				return group.size() * sizeof(delegate_handle);
+			}
+		};
+
+		struct delegate_attach : delegate_strategy<delegate<int>, subscribe_kind::attach>
+		{
+			using delegate_strategy::delegate_strategy;
+			static constexpr char const* name{ "delegate, attach" };
+		};
+
+		struct delegate_lambda : delegate_strategy<delegate<int>, subscribe_kind::lambda>
+		{
+			using delegate_strategy::delegate_strategy;
+			static constexpr char const* name{ "delegate, lambda" };
+		};
+
+		struct delegate_bound : delegate_strategy<delegate<int>, subscribe_kind::bound>
+		{
+			using delegate_strategy::delegate_strategy;
+			static constexpr char const* name{ "delegate, subscribe<Fn>" };
+		};
+
+		struct delegate_grouped : grouped_strategy<delegate<int>>
+		{
+			using grouped_strategy::grouped_strategy;
+			static constexpr char const* name{ "delegate, subscription_group" };
+		};
+
+		struct fast_lambda : delegate_strategy<delegate_fast<int>, subscribe_kind::lambda>
+		{
+			using delegate_strategy::delegate_strategy;
+			static constexpr char const* name{ "delegate_fast, lambda" };
+		};
+
+		struct fast_bound : delegate_strategy<delegate_fast<int>, subscribe_kind::bound>
+		{
+			using delegate_strategy::delegate_strategy;
+			static constexpr char const* name{ "delegate_fast, subscribe<Fn>" };
+		};
+
+		struct fast_grouped : grouped_strategy<delegate_fast<int>>
+		{
+			using grouped_strategy::grouped_strategy;
+			static constexpr char const* name{ "delegate_fast, subscription_group" };
+		};
+
+		using clock_type = std::chrono::steady_clock;
+
+		double elapsed_ns(clock_type::time_point start)
+		{
+			return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+		}
+
+		//how much work each measurement does, see main()
+		size_t g_operationBudget{ 1000000 };
+		size_t g_dispatchBudget{ 20000000 };
+
+		void print_row(char const* operation, char const* strategy, size_t listeners, double value, char const* unit)
+		{
+			std::printf("%-12s %-36s %8zu %12.2f %s\n", operation, strategy, listeners, value, unit);
+		}
+
+		/*
+		* Run every measurement for one strategy and listener count, and print the results.
+		*
+		* Params:
+		*	- listeners
+		*		How many listeners to subscribe.
+		*/
+		template<typename Strategy>
+		void run_strategy(size_t listeners)
+		{
+			std::vector<listener_object> objects(listeners);
+
+			//small listener counts are repeated until there's enough work to time reliably
+			size_t const rounds{ g_operationBudget / listeners > 0 ? g_operationBudget / listeners : 1 };
+			double subscribeNs{ 0 };
+			double unsubscribeNs{ 0 };
+			double moveNs{ 0 };
+			double teardownNs{ 0 };
+
+			counting_resource resource;
+			for (size_t round{ 0 }; round < rounds; ++round)
+			{
+				auto strategy{ std::make_unique<Strategy>(&resource) };
+
+				auto start{ clock_type::now() };
+				for (auto& object : objects)
+				{
+					strategy->subscribe(object);
+				}
+				subscribeNs += elapsed_ns(start);
+
+				if constexpr (Strategy::has_handles)
+				{
+					start = clock_type::now();
+					strategy->move_handles();
+					moveNs += elapsed_ns(start);
+				}
+
+				start = clock_type::now();
+				strategy->unsubscribe_all();
+				unsubscribeNs += elapsed_ns(start);
+
+				//teardown: everything subscribed, then the whole lot destroyed at once
+				for (auto& object : objects)
+				{
+					strategy->subscribe(object);
+				}
+				start = clock_type::now();
+				strategy.reset();
+				teardownNs += elapsed_ns(start);
+			}
+
+			double const operations{ static_cast<double>(rounds * listeners) };
+			print_row("subscribe", Strategy::name, listeners, subscribeNs / operations, "ns");
+			print_row("unsubscribe", Strategy::name, listeners, unsubscribeNs / operations, "ns");
+			if constexpr (Strategy::has_handles)
+			{
+				print_row("handle move", Strategy::name, listeners, moveNs / operations, "ns");
+			}
+			print_row("teardown", Strategy::name, listeners, teardownNs / operations, "ns");
+
+			Strategy strategy{ &resource };
+			for (auto& object : objects)
+			{
+				strategy.subscribe(object);
+			}
+
+			double const bytes{ static_cast<double>(resource.bytes() + strategy.handle_bytes()) };
+			print_row("memory", Strategy::name, listeners, bytes / static_cast<double>(listeners), "bytes");
+
+			size_t const dispatches{ g_dispatchBudget / listeners > 10 ? g_dispatchBudget / listeners : 10 };
+			//warm up once, so the first dispatch's cache misses aren't counted
+			strategy.dispatch(1);
+			auto const start{ clock_type::now() };
+			for (size_t i{ 0 }; i < dispatches; ++i)
+			{
+				strategy.dispatch(1);
+			}
+			print_row("dispatch", Strategy::name, listeners, elapsed_ns(start) / static_cast<double>(dispatches), "ns");
+		}
+
+		template<typename... Strategies>
+		void run_all(size_t listeners)
+		{
+			(run_strategy<Strategies>(listeners), ...);
+			std::printf("\n");
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace yadi::benchmarks;
+
+	if (argc > 1 && std::strcmp(argv[1], "quick") == 0)
+	{
+		g_operationBudget /= 100;
+		g_dispatchBudget /= 100;
+	}
+
+	std::printf("%-12s %-36s %8s %12s\n", "operation", "strategy", "listeners", "average");
+	for (size_t listeners : { 1, 8, 64, 1000, 100000 })
+	{
+		run_all<function_vector, pointer_array,
+			delegate_attach, delegate_lambda, delegate_bound, delegate_grouped,
+			fast_lambda, fast_bound, fast_grouped>(listeners);
+	}
+
+	//keeps g_sink (and so every listener's work) observable
+	std::printf("checksum: %u\n", g_sink);
+	return 0;
+}
@@ -7,12 +7,42 @@
 **********************************************************************************************/
 
 #include "../YADI/delegate.hpp"
-
+#include "../YADI/delegate_fast.hpp"
+#include "../YADI/delegate_interruptible.hpp"
+#include "../YADI/delegate_concurrent.hpp"
+#include "../YADI/delegate_parallel.hpp"
+#include "../YADI/delegate_queue.hpp"
+#include "../YADI/delegate_group.hpp"
+#include "../YADI/delegate_pool.hpp"
+#include "../YADI/delegate_static.hpp"
+#include "../YADI/delegate_bus.hpp"
+#include "../YADI/delegate_channel.hpp"
+#include "../YADI/delegate_intrusive.hpp"
+#include "../YADI/delegate_keyed.hpp"
+#include "../YADI/delegate_coalescing.hpp"
+#include "../YADI/delegate_affinity.hpp"
+#include "../YADI/delegate_compact.hpp"
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <thread>
+
+//instantiated once, in test_instantiations.cpp, which also checks that YADI links into more than one file
+YADI_COMMON_SIGNATURES(YADI_EXTERN_DELEGATE);
+YADI_COMMON_SIGNATURES(YADI_EXTERN_DELEGATE_FAST);
 
 /* Testing definitions
 *     TODO: Migrate to GTests or similar
 */
+//_ASSERT comes from MSVC's debug runtime. Everywhere else, report the failure and abort,
+//in every build configuration, so a failing test always fails the run.
+#ifndef _ASSERT
+#define _ASSERT(x) ((x) ? (void)0 : yadi::tests::assert_failed(#x, __FILE__, __LINE__))
+#endif
 //values must be equal
 //requires arg1.operator==(arg2)
 #define ASSERT_EQ(x, y) _ASSERT(x == y)
@@ -41,6 +71,13 @@ namespace yadi
 {
 	namespace tests
 	{
+		//used by _ASSERT when MSVC doesn't provide it, see the testing definitions above
+		[[noreturn]] void assert_failed(char const* expression, char const* file, int line)
+		{
+			std::cerr << file << "(" << line << "): assertion failed: " << expression << std::endl;
+			std::abort();
+		}
+
 		//useful class for testing functionality
 		struct example_class
 		{
@@ -564,23 +601,2333 @@ namespace yadi
 			free_increment = 0;
 
 			delete &instance;
+
+			//InterruptibleDelegate, interrupting on anything but the default (false-y) value
+			delegate_interruptible<bool, int> interruptible;
+
+			std::vector<int> callOrder;
+			delegate_handle first{ interruptible.subscribe([&callOrder](int a) { callOrder.push_back(1); return a == 1; }) };
+			delegate_handle second{ interruptible.subscribe([&callOrder](int a) { callOrder.push_back(2); return a == 2; }) };
+			delegate_handle third{ interruptible.subscribe([&callOrder](int) { callOrder.push_back(3); return false; }) };
+
+			//nobody interrupts, everyone runs in subscription order
+			auto result{ interruptible(0) };
+
+			ASSERT_FALSE(static_cast<bool>(result));
+			ASSERT_EQ(result.interrupted_by, nullptr);
+			ASSERT_TRUE((callOrder == std::vector<int>{ 1, 2, 3 }));
+
+			//the second listener interrupts, so the third never runs
+			callOrder.clear();
+			result = interruptible(2);
+
+			ASSERT_TRUE(static_cast<bool>(result));
+			ASSERT_EQ(result.interrupted_by, &second);
+			ASSERT_EQ(result.value, true);
+			ASSERT_TRUE((callOrder == std::vector<int>{ 1, 2 }));
+
+			//moving a handle keeps its place in line, and is reported as the new handle
+			delegate_handle movedFirst{ std::move(first) };
+			callOrder.clear();
+			result = interruptible(1);
+
+			ASSERT_EQ(result.interrupted_by, &movedFirst);
+			ASSERT_TRUE((callOrder == std::vector<int>{ 1 }));
+
+			//removing a listener keeps everyone else in order
+			movedFirst.unsubscribe();
+			callOrder.clear();
+			result = interruptible(0);
+
+			ASSERT_EQ(interruptible.subscriber_count(), 2);
+			ASSERT_TRUE((callOrder == std::vector<int>{ 2, 3 }));
+
+			//enough removals to close the holes up, with moved handles still finding their listener afterwards
+			{
+				delegate_interruptible<bool, int> ordered;
+				std::vector<int> order;
+				std::vector<delegate_handle> handles;
+				for (auto i{ 0 }; i < 10; ++i)
+				{
+					handles.push_back(ordered.subscribe([&order, i](int) { order.push_back(i); return false; }));
+				}
+				for (auto i{ 0 }; i < 10; i += 2)
+				{
+					handles[i].unsubscribe();
+				}
+				ASSERT_EQ(ordered.subscriber_count(), 5);
+				ordered(0);
+				ASSERT_TRUE((order == std::vector<int>{ 1, 3, 5, 7, 9 }));
+
+				delegate_handle moved{ std::move(handles[5]) };
+				moved.unsubscribe();
+				handles[9].unsubscribe();
+				order.clear();
+				ordered(0);
+				ASSERT_EQ(ordered.subscriber_count(), 3);
+				ASSERT_TRUE((order == std::vector<int>{ 1, 3, 7 }));
+			}
+
+			//handles are detached when the delegate is destroyed, so they may outlive it
+			{
+				delegate_handle outlives;
+				{
+					delegate_interruptible<bool, int> temporary;
+					outlives = temporary.subscribe([](int) { return false; });
+				}
+				delegate_handle moved{ std::move(outlives) };
+			}
+			static_assert(!std::is_copy_constructible_v<delegate_interruptible<bool, int>>);
+
+			//multiple return values, with a specified continue value
+			delegate_interruptible<int> chain{ -1 };
+			delegate_handle passes{ chain.subscribe([]() { return -1; }) };
+			delegate_handle answers{ chain.subscribe([]() { return 42; }) };
+			delegate_handle neverRuns{ chain.subscribe([]() { free_increment++; return 7; }) };
+
+			auto chainResult{ chain() };
+
+			ASSERT_EQ(chainResult.interrupted_by, &answers);
+			ASSERT_EQ(chainResult.value, 42);
+			ASSERT_EQ(free_increment, 0);
+
+			answers.unsubscribe();
+			chainResult = chain();
+
+			ASSERT_EQ(chainResult.interrupted_by, &neverRuns);
+			ASSERT_EQ(chainResult.value, 7);
+			ASSERT_EQ(free_increment, 1);
+
+			//an empty function isn't subscribed, so it can't be called
+			delegate_handle empty{ chain.subscribe(util::inplace_function<int()>{}) };
+			ASSERT_EQ(chain.subscriber_count(), 2);
+
+			free_increment = 0;
 		}
 
 		/*
-		* Run a test and print the result.
-		* Currently tests will fail asserts when something goes wrong, so this will only ever output success messages.
-		*
-		* Params:
-		*   - test
-		*       A pointer to the test function to run.
-		*   - label
-		*       What the test should be called in the console.
+		* Test yadi::delegate_fast, particularly the following:
+		*    - It accepts the same subscriptions and hands out the same delegate_handle as yadi::delegate
+		*    - Removing a subscription from the middle keeps every other subscription alive
+		*    - Moved handles keep their subscription
 		*/
-		void run_test(void(*test)(), std::string const& label)
+		void fast_delegate()
 		{
-			std::cout << "=======RUNNING TEST " << label << "=======" << std::endl;
-			test();
-			std::cout << "|||||||TEST COMPLETE||||||" << std::endl;
+			ASSERT_EQ(example_class::global_value, 0);
+			ASSERT_EQ(free_increment, 0);
+
+			delegate_fast<int> fastDelegate;
+			example_class testObject;
+
+			std::vector<delegate_handle> handles;
+			for (auto i{ 0 }; i < 10; ++i)
+			{
+				handles.push_back(fastDelegate.subscribe(&example_class::one_arg_function, testObject));
+			}
+			delegate_handle freeHandle{ fastDelegate.subscribe(&fn_one_arg) };
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 11);
+
+			fastDelegate(1);
+
+			ASSERT_EQ(testObject.local_value, 10);
+			ASSERT_EQ(free_increment, 1);
+
+			//remove from the middle and the front, forcing callbacks to be swapped around
+			handles[4].unsubscribe();
+			fastDelegate.unsubscribe(handles[0]);
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 9);
+
+			fastDelegate(1);
+
+			ASSERT_EQ(testObject.local_value, 18);
+			ASSERT_EQ(free_increment, 2);
+
+			//moving the handle should keep the subscription
+			delegate_handle movedHandle{ std::move(freeHandle) };
+			freeHandle.unsubscribe();
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 9);
+
+			fastDelegate(1);
+
+			ASSERT_EQ(free_increment, 3);
+
+			movedHandle.unsubscribe();
+			handles.clear();
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 0);
+
+			//clearing from the delegate side deactivates handles
+			{
+				delegate_handle handle{ fastDelegate.subscribe([](int a) { free_increment += a; }) };
+				fastDelegate.clear_all_subscriptions();
+				handle.unsubscribe();
+				fastDelegate(100);
+			}
+
+			ASSERT_EQ(free_increment, 3);
+
+			example_class::global_value = 0;
+			free_increment = 0;
 		}
-	}
-}
\ No newline at end of file
+
+		/*
+		* Test util::inplace_function, particularly the following:
+		*    - Storing free functions, lambdas, and lambdas with non-trivial captures
+		*    - Copying and moving keep the stored callable intact
+		*    - Empty functions report themselves as empty
+		*/
+		void inplace_functions()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			util::inplace_function<void(int)> empty;
+			ASSERT_FALSE(static_cast<bool>(empty));
+
+			util::inplace_function<void(int)> nullFunction{ static_cast<void(*)(int)>(nullptr) };
+			ASSERT_FALSE(static_cast<bool>(nullFunction));
+
+			util::inplace_function<void(int)> freeFunction{ &fn_one_arg };
+			ASSERT_TRUE(static_cast<bool>(freeFunction));
+
+			freeFunction(3);
+			ASSERT_EQ(free_increment, 3);
+
+			//a capture that has to be copied and destroyed properly
+			std::string suffix{ "xyz" };
+			util::inplace_function<std::string(std::string const&)> appender{
+				[suffix](std::string const& text) { return text + suffix; } };
+
+			ASSERT_EQ(appender("abc"), "abcxyz");
+
+			auto copied{ appender };
+			ASSERT_EQ(copied("1"), "1xyz");
+			ASSERT_EQ(appender("2"), "2xyz");
+
+			auto moved{ std::move(appender) };
+			ASSERT_FALSE(static_cast<bool>(appender));
+			ASSERT_EQ(moved("3"), "3xyz");
+
+			//reassignment replaces the callable
+			appender = copied;
+			ASSERT_EQ(appender("4"), "4xyz");
+			appender = nullptr;
+			ASSERT_FALSE(static_cast<bool>(appender));
+
+			//arguments passed by reference must stay references
+			util::inplace_function<void(int&)> doubler{ &fn_reference };
+			int value{ 4 };
+			doubler(value);
+			ASSERT_EQ(value, 8);
+
+			free_increment = 0;
+		}
+
+		/*
+		* Test subscriptions to functions known at compile time (subscribe<&fn>), particularly the following:
+		*    - Member functions, by pointer and by reference
+		*    - Virtual member functions still dispatch virtually
+		*    - Free functions
+		*    - Both yadi::delegate and yadi::delegate_fast, mixed with regular subscriptions
+		*/
+		void bound_subscribe()
+		{
+			ASSERT_EQ(example_class::global_value, 0);
+			ASSERT_EQ(free_increment, 0);
+
+			//the whole point is that these are as small as possible
+			static_assert(sizeof(util::bound_function<void(int)>) == 2 * sizeof(void*));
+
+			example_class testObject;
+
+			delegate<int> slowDelegate;
+			delegate_fast<int> fastDelegate;
+
+			{
+				delegate_handle memberHandle{ slowDelegate.subscribe<&example_class::one_arg_function>(testObject) };
+				delegate_handle freeHandle{ slowDelegate.subscribe<&fn_one_arg>() };
+
+				ASSERT_EQ(slowDelegate.subscriber_count(), 2);
+
+				slowDelegate(3);
+
+				ASSERT_EQ(testObject.local_value, 3);
+				ASSERT_EQ(free_increment, 3);
+			}
+
+			ASSERT_EQ(slowDelegate.subscriber_count(), 0);
+
+			{
+				delegate_handle memberHandle{ fastDelegate.subscribe<&example_class::one_arg_function>(&testObject) };
+				delegate_handle freeHandle{ fastDelegate.subscribe<&fn_one_arg>() };
+				delegate_handle regularHandle{ fastDelegate.subscribe(&example_class::one_arg_function, testObject) };
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 3);
+
+				fastDelegate(2);
+
+				ASSERT_EQ(testObject.local_value, 7);
+				ASSERT_EQ(free_increment, 5);
+
+				//remove the first bound subscription, making the other one move
+				memberHandle.unsubscribe();
+
+				//moving a bound subscription's handle keeps it alive
+				delegate_handle movedHandle{ std::move(freeHandle) };
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 2);
+
+				fastDelegate(1);
+
+				ASSERT_EQ(testObject.local_value, 8);
+				ASSERT_EQ(free_increment, 6);
+			}
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 0);
+
+			//virtual functions
+			delegate_fast<std::string const&> stringDelegate;
+			other_class secondObject;
+			{
+				delegate_handle handle{ stringDelegate.subscribe<&example_class::virtual_function>(static_cast<example_class*>(&secondObject)) };
+
+				stringDelegate("dog");
+
+				//if virtual lookup fails, this would be "abcdog" instead
+				ASSERT_EQ(secondObject.growing_string, "dog");
+			}
+
+			example_class::global_value = 0;
+			free_increment = 0;
+		}
+
+		/*
+		* Test yadi::concurrent_delegate, particularly the following:
+		*    - Basic subscribe/unsubscribe/move behaves like yadi::delegate
+		*    - Listeners may unsubscribe themselves while the delegate is executing
+		*    - Empty functions aren't subscribed, and handles may outlive the delegate
+		*    - Executing on one thread while other threads subscribe and unsubscribe
+		*/
+		void concurrent_execute()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			concurrent_delegate<int> concurrentDelegate;
+
+			{
+				delegate_handle handle{ concurrentDelegate.subscribe(&fn_one_arg) };
+				delegate_handle movedHandle{ std::move(handle) };
+
+				ASSERT_EQ(concurrentDelegate.subscriber_count(), 1);
+
+				concurrentDelegate(5);
+
+				ASSERT_EQ(free_increment, 5);
+			}
+
+			ASSERT_EQ(concurrentDelegate.subscriber_count(), 0);
+
+			//a listener that removes itself the first time it runs
+			{
+				delegate_handle selfRemoving;
+				selfRemoving = concurrentDelegate.subscribe([&selfRemoving](int a) {
+					free_increment += a;
+					selfRemoving.unsubscribe();
+				});
+
+				concurrentDelegate(1);
+				concurrentDelegate(1);
+
+				ASSERT_EQ(free_increment, 6);
+				ASSERT_EQ(concurrentDelegate.subscriber_count(), 0);
+			}
+
+			//an empty function isn't subscribed, so executing doesn't call it
+			{
+				delegate_handle empty{ concurrentDelegate.subscribe(nullptr) };
+				ASSERT_EQ(concurrentDelegate.subscriber_count(), 0);
+				concurrentDelegate(1);
+			}
+
+			//handles are detached when the delegate is destroyed, so they may outlive it
+			{
+				delegate_handle outlives;
+				{
+					concurrent_delegate<int> temporary;
+					outlives = temporary.subscribe(&fn_one_arg);
+				}
+				delegate_handle moved{ std::move(outlives) };
+			}
+			static_assert(!std::is_copy_constructible_v<concurrent_delegate<int>> && !std::is_copy_assignable_v<concurrent_delegate<int>>);
+
+			//worker threads churn subscriptions while this thread keeps executing
+			std::atomic<int> calls{ 0 };
+			std::atomic<bool> done{ false };
+			delegate_handle permanent{ concurrentDelegate.subscribe([&calls](int) { calls++; }) };
+
+			std::vector<std::thread> workers;
+			for (auto i{ 0 }; i < 4; ++i)
+			{
+				workers.emplace_back([&concurrentDelegate, &done]() {
+					while (!done)
+					{
+						delegate_handle handle{ concurrentDelegate.subscribe([](int) {}) };
+						delegate_handle moved{ std::move(handle) };
+					}
+				});
+			}
+
+			for (auto i{ 0 }; i < 2000; ++i)
+			{
+				concurrentDelegate(0);
+			}
+			done = true;
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+
+			//the permanent listener saw every single execution
+			ASSERT_EQ(calls.load(), 2000);
+			ASSERT_EQ(concurrentDelegate.subscriber_count(), 1);
+
+			//several threads executing while one churns subscriptions, so old listener lists get freed
+			//while readers that registered under either epoch may still be using them
+			std::atomic<int> started{ 0 };
+			std::atomic<bool> stop{ false };
+			std::atomic<long long> seen{ 0 };
+			std::vector<std::thread> readers;
+			for (auto i{ 0 }; i < 3; ++i)
+			{
+				readers.emplace_back([&concurrentDelegate, &started, &stop]() {
+					++started;
+					while (!stop)
+					{
+						concurrentDelegate(1);
+					}
+				});
+			}
+			while (started < 3)
+			{
+				std::this_thread::yield();
+			}
+			for (auto i{ 0 }; i < 20000; ++i)
+			{
+				//the listener reads what it captured, so using a freed list would read freed memory
+				std::array<int, 4> payload{ 1, 2, 3, 4 };
+				delegate_handle handle{ concurrentDelegate.subscribe([&seen, payload](int a) { seen += a * payload[3]; }) };
+			}
+			stop = true;
+			for (auto& reader : readers)
+			{
+				reader.join();
+			}
+			ASSERT_EQ(concurrentDelegate.subscriber_count(), 1);
+			ASSERT_EQ(seen.load() % 4, 0);
+
+			free_increment = 0;
+		}
+
+		/*
+		* Test delegate_fast::dispatch_parallel, particularly the following:
+		*    - Every listener is called exactly once, across both kinds of subscription
+		*    - Small delegates stay on the calling thread
+		*    - worker_pool runs nested parallel_for calls serially instead of deadlocking
+		*/
+		void parallel_execute()
+		{
+			worker_pool pool{ 3 };
+			ASSERT_EQ(pool.concurrency(), 4);
+
+			delegate_fast<int> fastDelegate;
+
+			//small delegate: everything should run right here
+			std::thread::id const caller{ std::this_thread::get_id() };
+			bool stayedHome{ true };
+			{
+				delegate_handle handle{ fastDelegate.subscribe([&stayedHome, caller](int) { stayedHome = stayedHome && std::this_thread::get_id() == caller; }) };
+				fastDelegate.dispatch_parallel(pool, 1);
+			}
+			ASSERT_TRUE(stayedHome);
+
+			//large delegate: every listener must run exactly once
+			constexpr size_t listener_count{ 5000 };
+			std::vector<std::atomic<int>> calls(listener_count);
+			std::atomic<int> boundCalls{ 0 };
+
+			std::vector<delegate_handle> handles;
+			for (size_t i{ 0 }; i < listener_count; ++i)
+			{
+				auto* counter{ &calls[i] };
+				handles.push_back(fastDelegate.subscribe([counter](int amount) { *counter += amount; }));
+			}
+			struct bound_counter
+			{
+				std::atomic<int>* total;
+				void add(int amount) { *total += amount; }
+			} boundCounter{ &boundCalls };
+			for (size_t i{ 0 }; i < 100; ++i)
+			{
+				handles.push_back(fastDelegate.subscribe<&bound_counter::add>(boundCounter));
+			}
+
+			fastDelegate.dispatch_parallel(pool, 2);
+			fastDelegate.dispatch_parallel(pool, 1);
+
+			for (auto const& count : calls)
+			{
+				ASSERT_EQ(count.load(), 3);
+			}
+			ASSERT_EQ(boundCalls.load(), 300);
+
+			//nested use of the pool
+			std::atomic<int> nestedCalls{ 0 };
+			pool.parallel_for(8, [&pool, &nestedCalls](size_t) {
+				pool.parallel_for(4, [&nestedCalls](size_t) { nestedCalls++; });
+			});
+			ASSERT_EQ(nestedCalls.load(), 32);
+		}
+
+		/*
+		* Test yadi::event_queue, particularly the following:
+		*    - Posted events are only delivered on drain(), in posting order
+		*    - Events posted while draining go to the next drain in double-buffered mode
+		*    - ...and to the same drain in single-buffered mode
+		*    - The queue still works as a regular delegate
+		*    - Reference arguments, rvalue ones included, are stored as values
+		*/
+		void queued_execute()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			event_queue<int, int> queue;
+			std::vector<int> received;
+
+			delegate_handle handle{ queue.subscribe([&received](int a, int b) { received.push_back(a * 10 + b); }) };
+
+			queue.post(1, 2);
+			queue.post(3, 4);
+
+			ASSERT_EQ(queue.pending_count(), 2);
+			ASSERT_TRUE(received.empty());
+
+			ASSERT_EQ(queue.drain(), 2);
+			ASSERT_TRUE((received == std::vector<int>{ 12, 34 }));
+			ASSERT_EQ(queue.pending_count(), 0);
+
+			//executing immediately still works
+			queue(5, 6);
+			ASSERT_TRUE((received == std::vector<int>{ 12, 34, 56 }));
+
+			//double-buffered: a listener posting a follow-up event
+			received.clear();
+			delegate_handle followUp{ queue.subscribe([&queue](int a, int) { if (a == 1) queue.post(2, 0); }) };
+
+			queue.post(1, 0);
+			ASSERT_EQ(queue.drain(), 1);
+			ASSERT_TRUE((received == std::vector<int>{ 10 }));
+			ASSERT_EQ(queue.pending_count(), 1);
+
+			ASSERT_EQ(queue.drain(), 1);
+			ASSERT_TRUE((received == std::vector<int>{ 10, 20 }));
+
+			//single-buffered: the follow-up event is delivered in the same drain
+			event_queue<int> singleQueue{ queue_mode::single_buffered };
+			delegate_handle chain{ singleQueue.subscribe([&singleQueue](int a) {
+				free_increment += a;
+				if (a > 1)
+				{
+					singleQueue.post(a - 1);
+				}
+			}) };
+
+			singleQueue.post(3);
+			ASSERT_EQ(singleQueue.drain(), 3);
+			ASSERT_EQ(free_increment, 6);
+			ASSERT_EQ(singleQueue.pending_count(), 0);
+
+			//references are stored as values
+			event_queue<std::string const&> stringQueue;
+			std::string text{ "abc" };
+			std::string received_text;
+			delegate_handle stringHandle{ stringQueue.subscribe([&received_text](std::string const& value) { received_text = value; }) };
+
+			stringQueue.post(text);
+			text = "changed";
+			stringQueue.drain();
+
+			ASSERT_EQ(received_text, "abc");
+
+			//rvalue references are stored as values too, and moved into the listener when drained
+			event_queue<std::string&&> movingQueue;
+			std::string taken;
+			delegate_handle movingHandle{ movingQueue.subscribe([&taken](std::string&& value) { taken = std::move(value); }) };
+
+			movingQueue.post(std::string{ "moved along" });
+			ASSERT_EQ(movingQueue.drain(), 1);
+
+			ASSERT_EQ(taken, "moved along");
+
+			free_increment = 0;
+		}
+
+		/*
+		* Test batched execution, particularly the following:
+		*    - invoke_batch in event-major and listener-major order
+		*    - Batch listeners receive the whole batch in one call, and single executions as a batch of one
+		*    - Batch subscriptions are removed and moved like any other
+		*    - event_queue hands its events to invoke_batch
+		*/
+		void batched_execute()
+		{
+			delegate<int> batchDelegate;
+			std::vector<int> calls;
+
+			delegate_handle first{ batchDelegate.subscribe([&calls](int a) { calls.push_back(a); }) };
+			delegate_handle second{ batchDelegate.subscribe([&calls](int a) { calls.push_back(a * 10); }) };
+
+			std::vector<delegate<int>::argument_pack> const batch{ { 1 }, { 2 }, { 3 } };
+
+			batchDelegate.invoke_batch(batch);
+
+			//one of the listeners must be first, but it isn't specified which
+			bool const tenFirst{ calls.front() == 10 };
+			std::vector<int> const eventMajor{ tenFirst
+				? std::vector<int>{ 10, 1, 20, 2, 30, 3 }
+				: std::vector<int>{ 1, 10, 2, 20, 3, 30 } };
+			ASSERT_TRUE(calls == eventMajor);
+
+			calls.clear();
+			batchDelegate.invoke_batch(batch, batch_order::listener_major);
+
+			std::vector<int> const listenerMajor{ tenFirst
+				? std::vector<int>{ 10, 20, 30, 1, 2, 3 }
+				: std::vector<int>{ 1, 2, 3, 10, 20, 30 } };
+			ASSERT_TRUE(calls == listenerMajor);
+
+			//batch listeners
+			int batchCalls{ 0 };
+			int batchTotal{ 0 };
+			delegate_handle batchHandle{ batchDelegate.subscribe_batch([&batchCalls, &batchTotal](std::span<std::tuple<int> const> events) {
+				batchCalls++;
+				for (auto const& event : events)
+				{
+					batchTotal += std::get<0>(event);
+				}
+			}) };
+
+			ASSERT_EQ(batchDelegate.subscriber_count(), 3);
+
+			batchDelegate.invoke_batch(batch);
+
+			ASSERT_EQ(batchCalls, 1);
+			ASSERT_EQ(batchTotal, 6);
+
+			batchDelegate(4);
+
+			ASSERT_EQ(batchCalls, 2);
+			ASSERT_EQ(batchTotal, 10);
+
+			delegate_handle movedBatchHandle{ std::move(batchHandle) };
+			batchDelegate(1);
+
+			ASSERT_EQ(batchCalls, 3);
+
+			movedBatchHandle.unsubscribe();
+			batchDelegate(1);
+
+			ASSERT_EQ(batchCalls, 3);
+			ASSERT_EQ(batchDelegate.subscriber_count(), 2);
+
+			//event_queue drains through invoke_batch
+			event_queue<int> queue;
+			delegate_handle queueBatch{ queue.subscribe_batch([&batchCalls](std::span<std::tuple<int> const> events) {
+				batchCalls += static_cast<int>(events.size());
+			}) };
+
+			queue.post(1);
+			queue.post(2);
+			queue.post(3);
+			queue.drain(batch_order::listener_major);
+
+			ASSERT_EQ(batchCalls, 6);
+		}
+
+		/*
+		* Test changing subscriptions while the delegate is executing, particularly the following:
+		*    - A listener unsubscribing itself, and one unsubscribing a listener that hasn't run yet
+		*    - A listener subscribing someone new, who only hears the next execution
+		*    - A listener moving handles around (including into reallocating vectors)
+		*    - A listener executing the delegate again
+		*    - Clearing all subscriptions from inside a listener
+		*/
+		void reentrant_execute()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			delegate<int> reentrant;
+
+			//self-removal, plus removal of everyone else
+			{
+				std::vector<delegate_handle> victims;
+				delegate_handle selfRemoving;
+				selfRemoving = reentrant.subscribe([&selfRemoving, &victims](int a) {
+					free_increment += a;
+					selfRemoving.unsubscribe();
+					victims.clear();
+				});
+				for (auto i{ 0 }; i < 10; ++i)
+				{
+					victims.push_back(reentrant.subscribe([](int a) { free_increment += a * 100; }));
+				}
+
+				reentrant(1);
+
+				//whoever ran before the self-removing listener got to run, nobody after it did
+				ASSERT_EQ(free_increment % 100, 1);
+				ASSERT_EQ(reentrant.subscriber_count(), 0);
+
+				int const previous{ free_increment };
+				reentrant(1);
+				ASSERT_EQ(free_increment, previous);
+			}
+			free_increment = 0;
+
+			//subscribing during execution
+			{
+				std::vector<delegate_handle> spawned;
+				delegate_handle spawner{ reentrant.subscribe([&spawned, &reentrant](int) {
+					spawned.push_back(reentrant.subscribe([](int a) { free_increment += a; }));
+				}) };
+
+				reentrant(1);
+
+				//the new listener must not hear the event that created it
+				ASSERT_EQ(free_increment, 0);
+				ASSERT_EQ(reentrant.subscriber_count(), 2);
+
+				reentrant(1);
+
+				ASSERT_EQ(free_increment, 1);
+				ASSERT_EQ(reentrant.subscriber_count(), 3);
+
+				//and one that subscribes and unsubscribes within the same execution
+				spawner = reentrant.subscribe([&reentrant](int) {
+					delegate_handle temporary{ reentrant.subscribe([](int) {}) };
+				});
+				spawned.clear();
+				reentrant(1);
+				ASSERT_EQ(reentrant.subscriber_count(), 1);
+			}
+			free_increment = 0;
+
+			//moving handles during execution, with lots of reallocation
+			{
+				std::vector<delegate_handle> handles;
+				for (auto i{ 0 }; i < 4; ++i)
+				{
+					handles.push_back(reentrant.subscribe([](int a) { free_increment += a; }));
+				}
+				handles.push_back(reentrant.subscribe([&handles](int) {
+					handles.shrink_to_fit();
+					std::vector<delegate_handle> moved;
+					for (auto& handle : handles)
+					{
+						moved.push_back(std::move(handle));
+					}
+					handles = std::move(moved);
+				}));
+
+				reentrant(1);
+
+				//every subscription was still called exactly once
+				ASSERT_EQ(free_increment, 4);
+				ASSERT_EQ(reentrant.subscriber_count(), 5);
+
+				reentrant(1);
+				ASSERT_EQ(free_increment, 8);
+
+				//the moved handles still control their subscriptions
+				handles.clear();
+				ASSERT_EQ(reentrant.subscriber_count(), 0);
+				reentrant(1);
+				ASSERT_EQ(free_increment, 8);
+			}
+			free_increment = 0;
+
+			//executing recursively, and clearing from inside
+			{
+				delegate_handle recursive{ reentrant.subscribe([&reentrant](int a) {
+					free_increment++;
+					if (a > 0)
+					{
+						reentrant(a - 1);
+					}
+				}) };
+				delegate_handle other{ reentrant.subscribe([](int) { free_increment += 10; }) };
+
+				reentrant(2);
+				ASSERT_EQ(free_increment, 33);
+
+				delegate_handle clearer{ reentrant.subscribe([&reentrant](int) { reentrant.clear_all_subscriptions(); }) };
+				reentrant(0);
+
+				ASSERT_EQ(reentrant.subscriber_count(), 0);
+
+				//handles were deactivated, these should do nothing
+				recursive.unsubscribe();
+				other.unsubscribe();
+				clearer.unsubscribe();
+			}
+
+			free_increment = 0;
+		}
+
+		/*
+		* Test delegate_fast's slot-based handles, particularly the following:
+		*     - Handles moving around in a reallocating vector
+		*     - Unsubscribing out of order after lots of moves
+		*     - Stale handles after clear_all_subscriptions, with their slots reused
+		*/
+		void slot_handles()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			delegate_fast<int> fastDelegate;
+
+			{
+				//no reserve, so the vector reallocates and moves every handle several times
+				std::vector<delegate_handle> handles;
+				for (auto i{ 0 }; i < 100; ++i)
+				{
+					handles.push_back(fastDelegate.subscribe([](int a) { free_increment += a; }));
+				}
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 100);
+
+				fastDelegate(1);
+
+				ASSERT_EQ(free_increment, 100);
+
+				//erasing from the front moves every handle after it
+				handles.erase(handles.begin(), handles.begin() + 10);
+				handles.erase(handles.begin() + 20);
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 89);
+
+				fastDelegate(1);
+
+				ASSERT_EQ(free_increment, 189);
+
+				//move assignment onto a live handle drops the old subscription
+				handles[0] = std::move(handles[1]);
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 88);
+			}
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 0);
+			free_increment = 0;
+
+			//a cleared handle must not remove whoever gets its slot next
+			{
+				delegate_handle stale{ fastDelegate.subscribe([](int a) { free_increment += a; }) };
+				fastDelegate.clear_all_subscriptions();
+
+				delegate_handle fresh{ fastDelegate.subscribe([](int a) { free_increment += a * 10; }) };
+				stale.unsubscribe();
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 1);
+
+				fastDelegate(1);
+
+				ASSERT_EQ(free_increment, 10);
+
+				delegate_handle moved{ std::move(fresh) };
+				fresh.unsubscribe();
+
+				ASSERT_EQ(fastDelegate.subscriber_count(), 1);
+			}
+
+			ASSERT_EQ(fastDelegate.subscriber_count(), 0);
+
+			//handles may outlive their delegate: slot handles keep its anchor alive, others are detached
+			//(otherwise destroying them below would call into a dead delegate)
+			{
+				delegate_handle outlives;
+				delegate_handle outlivesCleared;
+				delegate_handle outlivesKeyed;
+				{
+					delegate_fast<int> temporary;
+					outlives = temporary.subscribe([](int a) { free_increment += a; });
+					delegate_handle moved{ std::move(outlives) };
+					outlives = std::move(moved);
+					outlivesCleared = temporary.subscribe<&fn_one_arg>();
+					temporary.clear_all_subscriptions();
+					outlives = temporary.subscribe([](int a) { free_increment += a; });
+
+					keyed_delegate<int, int> keyed;
+					outlivesKeyed = keyed.subscribe(1, [](int a) { free_increment += a; });
+				}
+				outlivesCleared.unsubscribe();
+				delegate_handle moved{ std::move(outlives) };
+			}
+			{
+				delegate_handle outlives;
+				{
+					delegate<int> temporary;
+					outlives = temporary.subscribe([](int a) { free_increment += a; });
+				}
+			}
+			//a copy would share the original's anchor, and orphan it from under the original's handles
+			static_assert(!std::is_copy_constructible_v<delegate<int>> && !std::is_copy_assignable_v<delegate<int>>);
+
+			//an empty function isn't subscribed
+			delegate_handle empty{ fastDelegate.subscribe(util::inplace_function<void(int)>{}) };
+			ASSERT_EQ(fastDelegate.subscriber_count(), 0);
+			fastDelegate(1);
+
+			free_increment = 0;
+		}
+
+		/*
+		* Test subscription_group, particularly the following:
+		*     - One group holding subscriptions to several kinds of delegates
+		*     - Clearing the group removes only its own subscriptions
+		*     - Handles dropped by their delegate before the group is cleared
+		*     - Moving a group
+		*     - Delegates destroyed before the group
+		*/
+		void grouped_unsubscribe()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			delegate<int> basicDelegate;
+			delegate_fast<int> fastDelegate;
+			concurrent_delegate<int> concurrentDelegate;
+			delegate_interruptible<bool, int> interruptible;
+
+			//subscriptions that aren't part of any group, which must survive
+			delegate_handle outsider{ basicDelegate.subscribe([](int a) { free_increment += a * 1000; }) };
+			delegate_handle fastOutsider{ fastDelegate.subscribe([](int a) { free_increment += a * 1000; }) };
+
+			{
+				subscription_group group;
+				for (auto i{ 0 }; i < 50; ++i)
+				{
+					group += basicDelegate.subscribe([](int a) { free_increment += a; });
+					group += fastDelegate.subscribe([](int a) { free_increment += a; });
+				}
+				group += concurrentDelegate.subscribe([](int a) { free_increment += a; });
+				group += interruptible.subscribe([](int a) { free_increment += a; return false; });
+				group.add(basicDelegate.subscribe_batch([](std::span<std::tuple<int> const> events) { free_increment += static_cast<int>(events.size()); }));
+
+				//empty handles are ignored
+				group.add(delegate_handle{});
+
+				ASSERT_EQ(group.size(), 103);
+				ASSERT_EQ(basicDelegate.subscriber_count(), 52);
+				ASSERT_EQ(fastDelegate.subscriber_count(), 51);
+
+				basicDelegate(1);
+				fastDelegate(1);
+				concurrentDelegate(1);
+				interruptible(1);
+
+				ASSERT_EQ(free_increment, 2000 + 50 + 1 + 50 + 1 + 1);
+
+				subscription_group moved{ std::move(group) };
+				ASSERT_EQ(moved.size(), 103);
+
+				//the delegate drops these itself, the group must cope
+				concurrentDelegate.clear_all_subscriptions();
+			}
+
+			ASSERT_EQ(basicDelegate.subscriber_count(), 1);
+			ASSERT_EQ(fastDelegate.subscriber_count(), 1);
+			ASSERT_EQ(concurrentDelegate.subscriber_count(), 0);
+			ASSERT_EQ(interruptible.subscriber_count(), 0);
+
+			free_increment = 0;
+			basicDelegate(1);
+			fastDelegate(1);
+
+			ASSERT_EQ(free_increment, 2000);
+
+			//a small group against a big delegate takes the lookup path instead of the walk
+			{
+				std::vector<delegate_handle> crowd;
+				for (auto i{ 0 }; i < 100; ++i)
+				{
+					crowd.push_back(basicDelegate.subscribe([](int) {}));
+				}
+
+				subscription_group group;
+				group += basicDelegate.subscribe([](int a) { free_increment += a; });
+				group += basicDelegate.subscribe([](int a) { free_increment += a; });
+
+				ASSERT_EQ(basicDelegate.subscriber_count(), 103);
+
+				group.clear();
+
+				ASSERT_EQ(basicDelegate.subscriber_count(), 101);
+				ASSERT_EQ(group.size(), 0);
+			}
+
+			//slot handles may outlive their delegate, and a cleared one can't remove whoever got its slot next
+			free_increment = 0;
+			{
+				subscription_group group;
+				{
+					delegate<int> temporary;
+					group += temporary.subscribe([](int) {});
+				}
+				delegate_fast<int> reused;
+				group += reused.subscribe([](int a) { free_increment += a; });
+				reused.clear_all_subscriptions();
+				delegate_handle survivor{ reused.subscribe([](int a) { free_increment += a * 10; }) };
+				group += reused.subscribe([](int a) { free_increment += a * 100; });
+
+				group.clear();
+
+				ASSERT_EQ(reused.subscriber_count(), 1);
+				reused(1);
+				ASSERT_EQ(free_increment, 10);
+			}
+
+			free_increment = 0;
+		}
+
+		//keeps track of how many bytes are currently allocated through it
+		struct counting_resource : public std::pmr::memory_resource
+		{
+			size_t outstanding{ 0 };
+
+			void* do_allocate(size_t bytes, size_t alignment) override
+			{
+				outstanding += bytes;
+				return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+			}
+
+			void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+			{
+				outstanding -= bytes;
+				std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+			}
+
+			bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+			{
+				return this == &other;
+			}
+		};
+
+		/*
+		* Test delegates allocating from a subscription_pool, particularly the following:
+		*     - Subscriptions to a yadi::delegate come out of the pool's blocks
+		*     - Blocks are reused after unsubscribing
+		*     - Every delegate type accepts a memory resource
+		*     - Releasing the pool wholesale, including allocations too big for a block
+		*/
+		void pooled_subscribe()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			//instrumentation keeps a timing histogram in every subscription
+			subscription_pool pool{ YADI_INSTRUMENTATION ? 512 : YADI_SUBSCRIPTION_POOL_BLOCK_SIZE, 16 };
+
+			{
+				delegate<int> basicDelegate{ &pool };
+				std::vector<delegate_handle> handles;
+				handles.reserve(40);
+				for (auto i{ 0 }; i < 40; ++i)
+				{
+					handles.push_back(basicDelegate.subscribe([](int a) { free_increment += a; }));
+				}
+
+				ASSERT_EQ(pool.blocks_in_use(), 40);
+
+				basicDelegate(1);
+
+				ASSERT_EQ(free_increment, 40);
+
+				//freed blocks are handed out again
+				handles.resize(10);
+				ASSERT_EQ(pool.blocks_in_use(), 10);
+				for (auto i{ 0 }; i < 30; ++i)
+				{
+					handles.push_back(basicDelegate.subscribe([](int a) { free_increment += a; }));
+				}
+				ASSERT_EQ(pool.blocks_in_use(), 40);
+
+				//the rest of the delegate family takes a resource too
+				delegate_fast<int> fastDelegate{ &pool };
+				delegate_interruptible<bool, int> interruptible{ false, &pool };
+				concurrent_delegate<int> concurrentDelegate{ &pool };
+				event_queue<int> queue{ queue_mode::double_buffered, &pool };
+
+				delegate_handle fastHandle{ fastDelegate.subscribe([](int a) { free_increment += a; }) };
+				delegate_handle interruptHandle{ interruptible.subscribe([](int a) { free_increment += a; return false; }) };
+				delegate_handle concurrentHandle{ concurrentDelegate.subscribe([](int a) { free_increment += a; }) };
+				delegate_handle queueHandle{ queue.subscribe([](int a) { free_increment += a; }) };
+
+				free_increment = 0;
+				fastDelegate(1);
+				interruptible(1);
+				concurrentDelegate(1);
+				queue.post(1);
+				queue.drain();
+
+				ASSERT_EQ(free_increment, 4);
+			}
+
+			ASSERT_EQ(pool.blocks_in_use(), 0);
+
+			//a subsystem going away all at once
+			{
+				delegate<int> basicDelegate{ &pool };
+				std::vector<delegate_handle> handles;
+				for (auto i{ 0 }; i < 20; ++i)
+				{
+					handles.push_back(basicDelegate.subscribe([](int) {}));
+				}
+				handles.clear();
+			}
+			pool.release();
+
+			ASSERT_EQ(pool.blocks_in_use(), 0);
+
+			//allocations too big or too aligned for a block go upstream, and release() gets those back too
+			counting_resource upstream;
+			{
+				subscription_pool tracked{ YADI_SUBSCRIPTION_POOL_BLOCK_SIZE, 16, &upstream };
+				void* const small{ tracked.allocate(16) };
+				void* const big{ tracked.allocate(4096) };
+				void* const aligned{ tracked.allocate(64, 256) };
+				ASSERT_EQ(reinterpret_cast<uintptr_t>(aligned) % 256, 0);
+				size_t const withAll{ upstream.outstanding };
+				tracked.deallocate(big, 4096);
+				ASSERT_LT(upstream.outstanding, withAll);
+				ASSERT_TRUE(small != nullptr);
+
+				//never freed, but the pool still hands it back
+				void* const forgotten{ tracked.allocate(8192) };
+				ASSERT_TRUE(forgotten != nullptr);
+				tracked.release();
+				ASSERT_EQ(upstream.outstanding, 0);
+			}
+			ASSERT_EQ(upstream.outstanding, 0);
+
+			free_increment = 0;
+		}
+
+		/*
+		* Test the dispatch instrumentation. The tests are built twice, with and without YADI_INSTRUMENTATION,
+		* so this checks the following in both:
+		*     - Named delegates show up in the hottest delegates, with their execution counts
+		*     - Per-listener timing, and which subscription it's reported against
+		*     - Resetting the numbers
+		*     - Without instrumentation, there is never anything to report
+		*/
+		void instrumented_execute()
+		{
+			ASSERT_EQ(free_increment, 0);
+
+			delegate<int> named;
+			named.set_name("instrumented_execute");
+			named.set_listener_timing(true);
+
+			delegate_fast<int> fastNamed;
+			fastNamed.set_name("instrumented_execute fast");
+
+			delegate_handle first{ named.subscribe([](int a) { free_increment += a; }) };
+			delegate_handle second{ named.subscribe([](int a) { free_increment += a; }) };
+			delegate_handle fastHandle{ fastNamed.subscribe([](int a) { free_increment += a; }) };
+
+			named(1);
+			named(1);
+			fastNamed(1);
+
+			ASSERT_EQ(free_increment, 5);
+
+			auto& registry{ instrumentation::registry::instance() };
+			auto const hottest{ registry.hottest_delegates(1000) };
+			auto const slowest{ registry.slowest_listeners(1000) };
+
+#if YADI_INSTRUMENTATION
+			size_t found{ 0 };
+			for (auto const& report : hottest)
+			{
+				if (report.name == "instrumented_execute")
+				{
+					ASSERT_EQ(report.dispatch.count, 2);
+					++found;
+				}
+				else if (report.name == "instrumented_execute fast")
+				{
+					ASSERT_EQ(report.dispatch.count, 1);
+					++found;
+				}
+			}
+			ASSERT_EQ(found, 2);
+
+			//only the delegate with listener timing on reports its listeners
+			ASSERT_EQ(slowest.size(), 2);
+			for (auto const& report : slowest)
+			{
+				ASSERT_EQ(report.delegate_name, "instrumented_execute");
+				ASSERT_EQ(report.calls.count, 2);
+				ASSERT_TRUE(report.id == 0 || report.id == 1);
+			}
+			ASSERT_TRUE(slowest[0].id != slowest[1].id);
+
+			//moving a handle doesn't change its listener's report, and removing it drops the report
+			delegate_handle moved{ std::move(first) };
+			ASSERT_EQ(registry.slowest_listeners(1000).size(), 2);
+			second.unsubscribe();
+			auto const remaining{ registry.slowest_listeners(1000) };
+			ASSERT_EQ(remaining.size(), 1);
+			ASSERT_EQ(remaining[0].id, 0);
+
+			registry.reset();
+			for (auto const& report : registry.hottest_delegates(1000))
+			{
+				ASSERT_EQ(report.dispatch.count, 0);
+			}
+			for (auto const& report : registry.slowest_listeners(1000))
+			{
+				ASSERT_EQ(report.calls.count, 0);
+			}
+#else
+			ASSERT_TRUE(hottest.empty());
+			ASSERT_TRUE(slowest.empty());
+#endif
+
+			free_increment = 0;
+		}
+
+		//counts every copy and move made of it
+		struct copy_counter
+		{
+			static inline size_t copies{ 0 };
+			static inline size_t moves{ 0 };
+
+			copy_counter() = default;
+			copy_counter(copy_counter const&) { ++copies; }
+			copy_counter(copy_counter&&) noexcept { ++moves; }
+			copy_counter& operator=(copy_counter const&) { ++copies; return *this; }
+			copy_counter& operator=(copy_counter&&) noexcept { ++moves; return *this; }
+
+			static void reset()
+			{
+				copies = 0;
+				moves = 0;
+			}
+		};
+
+		void copy_counter_by_value(copy_counter) {}
+
+		void zero_copy_execute()
+		{
+			copy_counter::reset();
+			copy_counter argument;
+
+			//listeners taking const references never cause a copy, however many there are
+			delegate<copy_counter> shared;
+			delegate_handle first{ shared.subscribe([](copy_counter const&) {}) };
+			delegate_handle second{ shared.subscribe([](copy_counter const&) {}) };
+			delegate_handle third{ shared.subscribe([](copy_counter const&) {}) };
+			shared(argument);
+			ASSERT_EQ(copy_counter::copies, 0);
+			ASSERT_EQ(copy_counter::moves, 0);
+
+			delegate_fast<copy_counter> fastShared;
+			delegate_handle fastFirst{ fastShared.subscribe([](copy_counter const&) {}) };
+			delegate_handle fastSecond{ fastShared.subscribe<&copy_counter_by_value>() };
+			fastShared(argument);
+			ASSERT_EQ(copy_counter::copies, 1);
+			ASSERT_EQ(copy_counter::moves, 0);
+			copy_counter::reset();
+
+			//listeners taking arguments by value get one copy each, and nothing else
+			delegate<copy_counter> byValue;
+			delegate_handle valueFirst{ byValue.subscribe([](copy_counter) {}) };
+			delegate_handle valueSecond{ byValue.subscribe<&copy_counter_by_value>() };
+			delegate_handle valueThird{ byValue.subscribe([](copy_counter) {}) };
+			byValue(argument);
+			ASSERT_EQ(copy_counter::copies, 3);
+			ASSERT_EQ(copy_counter::moves, 0);
+			copy_counter::reset();
+
+			//the last listener takes the argument over instead of copying it
+			//(one move into invoke_move_last's parameter, one into the listener)
+			byValue.invoke_move_last(std::move(argument));
+			ASSERT_EQ(copy_counter::copies, 2);
+			ASSERT_EQ(copy_counter::moves, 2);
+			copy_counter::reset();
+
+			//with the last listener gone, the one before it is the last
+			//(a temporary goes straight into the parameter, so the only move is into the listener)
+			valueThird.unsubscribe();
+			byValue.invoke_move_last(copy_counter{});
+			ASSERT_EQ(copy_counter::copies, 1);
+			ASSERT_EQ(copy_counter::moves, 1);
+			copy_counter::reset();
+
+			//every listener still sees the whole argument, even though the last one moves from it
+			delegate<std::string> strings;
+			size_t fullLength{ 0 };
+			delegate_handle stringFirst{ strings.subscribe([&fullLength](std::string text) { fullLength += text.size(); }) };
+			delegate_handle stringSecond{ strings.subscribe([&fullLength](std::string text) { fullLength += text.size(); }) };
+			std::string message{ "long enough to not fit in the small string buffer" };
+			strings(message);
+			ASSERT_EQ(fullLength, message.size() * 2);
+			strings.invoke_move_last(message);
+			ASSERT_EQ(fullLength, message.size() * 4);
+
+			//rvalue reference arguments are shared like values: nobody moves them away from the others
+			delegate<std::string&&> rvalues;
+			std::vector<std::string> seen;
+			delegate_handle rvalueFirst{ rvalues.subscribe([&seen](std::string text) { seen.push_back(std::move(text)); }) };
+			delegate_handle rvalueSecond{ rvalues.subscribe([&seen](std::string text) { seen.push_back(std::move(text)); }) };
+			delegate_handle rvalueThird{ rvalues.subscribe([&seen](std::string text) { seen.push_back(std::move(text)); }) };
+			rvalues(std::string{ message });
+			ASSERT_EQ(seen.size(), 3);
+			for (auto const& text : seen)
+			{
+				ASSERT_EQ(text, message);
+			}
+
+			copy_counter::reset();
+			delegate<copy_counter&&> counted;
+			delegate_handle countedFirst{ counted.subscribe([](copy_counter) {}) };
+			delegate_handle countedSecond{ counted.subscribe<&copy_counter_by_value>() };
+			//a listener taking an rvalue reference gets its own copy to move from
+			delegate_handle countedThird{ counted.subscribe([](copy_counter&& taken) { copy_counter mine{ std::move(taken) }; }) };
+			counted(copy_counter{});
+			ASSERT_EQ(copy_counter::copies, 3);
+			ASSERT_EQ(copy_counter::moves, 1);
+			copy_counter::reset();
+
+			//only the last listener may take it over
+			countedThird.unsubscribe();
+			counted.invoke_move_last(copy_counter{});
+			ASSERT_EQ(copy_counter::copies, 1);
+			ASSERT_EQ(copy_counter::moves, 1);
+			copy_counter::reset();
+
+			delegate_fast<std::string&&> fastRvalues;
+			seen.clear();
+			delegate_handle fastRvalueFirst{ fastRvalues.subscribe([&seen](std::string text) { seen.push_back(std::move(text)); }) };
+			delegate_handle fastRvalueSecond{ fastRvalues.subscribe([&seen](std::string text) { seen.push_back(std::move(text)); }) };
+			fastRvalues(std::string{ message });
+			ASSERT_EQ(seen.size(), 2);
+			ASSERT_EQ(seen[0], message);
+			ASSERT_EQ(seen[1], message);
+		}
+
+		void static_execute()
+		{
+			ASSERT_EQ(free_increment, 0);
+			ASSERT_EQ(example_class::global_value, 0);
+
+			example_class first;
+			other_class second;
+
+			//instances are given in the order their member functions are listed
+			static_delegate<listeners<&fn_one_arg, &example_class::one_arg_function, [](int a) { free_increment += a * 10; },
+				&example_class::one_arg_function>, int> fixed{ &first, &second };
+			static_assert(decltype(fixed)::subscriber_count() == 4);
+
+			fixed(2);
+			ASSERT_EQ(free_increment, 22);
+			ASSERT_EQ(first.local_value, 2);
+			ASSERT_EQ(second.local_value, 2);
+			ASSERT_EQ(example_class::global_value, 4);
+
+			//same argument rules as yadi::delegate
+			copy_counter::reset();
+			static_delegate<listeners<[](copy_counter const&) {}, &copy_counter_by_value, &copy_counter_by_value>, copy_counter> counted;
+			copy_counter argument;
+			counted(argument);
+			ASSERT_EQ(copy_counter::copies, 2);
+			ASSERT_EQ(copy_counter::moves, 0);
+			copy_counter::reset();
+
+			counted.invoke_move_last(std::move(argument));
+			ASSERT_EQ(copy_counter::copies, 1);
+			ASSERT_EQ(copy_counter::moves, 2);
+			copy_counter::reset();
+
+			//references are passed straight through
+			static_delegate<listeners<&fn_reference, &fn_reference>, int&> doubling;
+			int value{ 3 };
+			doubling(value);
+			ASSERT_EQ(value, 12);
+
+			free_increment = 0;
+			example_class::global_value = 0;
+		}
+
+		struct damage_event
+		{
+			int amount;
+		};
+
+		struct heal_event
+		{
+			int amount;
+		};
+
+		struct health_component
+		{
+			int health{ 100 };
+
+			void on_damage(damage_event const& event)
+			{
+				health -= event.amount;
+			}
+		};
+
+		void bus_publish()
+		{
+			event_bus bus;
+			health_component player;
+
+			//nothing is subscribed yet, so nothing happens
+			bus.publish(damage_event{ 10 });
+			ASSERT_EQ(bus.subscriber_count<damage_event>(), 0);
+
+			delegate_handle damage{ bus.subscribe<damage_event>(&health_component::on_damage, &player) };
+			delegate_handle boundDamage{ bus.subscribe<damage_event, &health_component::on_damage>(&player) };
+			int healed{ 0 };
+			delegate_handle heal{ bus.subscribe<heal_event>([&healed](heal_event const& event) { healed += event.amount; }) };
+			ASSERT_EQ(bus.subscriber_count<damage_event>(), 2);
+			ASSERT_EQ(bus.subscriber_count<heal_event const>(), 1);
+
+			//events only reach listeners of their own type
+			bus.publish(damage_event{ 10 });
+			ASSERT_EQ(player.health, 80);
+			ASSERT_EQ(healed, 0);
+
+			heal_event const potion{ 5 };
+			bus.publish(potion);
+			ASSERT_EQ(player.health, 80);
+			ASSERT_EQ(healed, 5);
+
+			//listeners may publish other events, and subscribe to other types
+			delegate_handle late;
+			bool subscribedLate{ false };
+			delegate_handle chain{ bus.subscribe<heal_event>([&bus, &late, &subscribedLate, &player](heal_event const& event)
+			{
+				bus.publish(damage_event{ event.amount });
+				if (!subscribedLate)
+				{
+					late = bus.subscribe<int>([&player](int amount) { player.health += amount; });
+					subscribedLate = true;
+				}
+			}) };
+			bus.publish(heal_event{ 1 });
+			ASSERT_EQ(player.health, 78);
+			ASSERT_EQ(healed, 6);
+			bus.publish(3);
+			ASSERT_EQ(player.health, 81);
+
+			damage.unsubscribe();
+			bus.publish(damage_event{ 1 });
+			ASSERT_EQ(player.health, 80);
+
+			bus.clear_subscriptions<heal_event>();
+			bus.publish(potion);
+			ASSERT_EQ(healed, 6);
+			ASSERT_EQ(bus.subscriber_count<heal_event>(), 0);
+
+			//every bus agrees on event type indexes
+			ASSERT_EQ(util::type_index::of<damage_event>(), util::type_index::of<damage_event>());
+			ASSERT_TRUE(util::type_index::of<damage_event>() != util::type_index::of<heal_event>());
+		}
+
+		void channel_pump()
+		{
+			//nothing is delivered until pump()
+			delegate_channel<int> dropNewest{ 4 };
+			int total{ 0 };
+			delegate_handle counter{ dropNewest.subscribe([&total](int a) { total += a; }) };
+			ASSERT_EQ(dropNewest.capacity(), 4);
+			for (int i{ 1 }; i <= 4; ++i)
+			{
+				ASSERT_TRUE(dropNewest.post(i));
+			}
+			ASSERT_TRUE(!dropNewest.post(100));
+			ASSERT_EQ(total, 0);
+			ASSERT_EQ(dropNewest.depth(), 4);
+
+			ASSERT_EQ(dropNewest.pump(), 4);
+			ASSERT_EQ(total, 10);
+			ASSERT_EQ(dropNewest.depth(), 0);
+
+			channel_stats const stats{ dropNewest.stats() };
+			ASSERT_EQ(stats.posted, 4);
+			ASSERT_EQ(stats.delivered, 4);
+			ASSERT_EQ(stats.dropped, 1);
+			ASSERT_EQ(stats.high_water, 4);
+
+			//the oldest events make room for new ones
+			delegate_channel<std::string> dropOldest{ 2, overflow_policy::drop_oldest };
+			std::string received;
+			delegate_handle appender{ dropOldest.subscribe([&received](std::string text) { received += text; }) };
+			ASSERT_TRUE(dropOldest.post("a"));
+			ASSERT_TRUE(dropOldest.post("b"));
+			ASSERT_TRUE(dropOldest.post("c"));
+			ASSERT_EQ(dropOldest.pump(), 2);
+			ASSERT_EQ(received, "bc");
+			ASSERT_EQ(dropOldest.stats().dropped, 1);
+
+			//pump() can be limited, and events keep their order
+			dropOldest.post("d");
+			dropOldest.post("e");
+			ASSERT_EQ(dropOldest.pump(1), 1);
+			ASSERT_EQ(received, "bcd");
+			ASSERT_EQ(dropOldest.pump(), 1);
+			ASSERT_EQ(received, "bcde");
+
+			//while the consumer is still delivering the oldest event, posting drops one event, not the whole ring
+			{
+				delegate_channel<int> slow{ 4, overflow_policy::drop_oldest };
+				std::vector<int> delivered;
+				std::atomic<bool> inside{ false };
+				std::atomic<bool> release{ false };
+				delegate_handle sleeper{ slow.subscribe([&delivered, &inside, &release](int a)
+				{
+					delivered.push_back(a);
+					inside = true;
+					while (!release)
+					{
+						std::this_thread::yield();
+					}
+				}) };
+				for (int i{ 1 }; i <= 4; ++i)
+				{
+					slow.post(i);
+				}
+				std::thread consumer{ [&slow]() { slow.pump(); } };
+				while (!inside)
+				{
+					std::this_thread::yield();
+				}
+				std::thread producer{ [&slow]() { slow.post(99); } };
+				std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+				release = true;
+				producer.join();
+				consumer.join();
+				slow.pump();
+				ASSERT_EQ(slow.stats().dropped, 1);
+				ASSERT_EQ(delivered.size(), 4);
+				ASSERT_EQ(delivered[0], 1);
+				ASSERT_EQ(delivered[1], 3);
+				ASSERT_EQ(delivered[2], 4);
+				ASSERT_EQ(delivered[3], 99);
+			}
+
+			//many producers, one consumer
+			delegate_channel<int> shared{ 64, overflow_policy::wait };
+			long long sum{ 0 };
+			size_t count{ 0 };
+			delegate_handle summer{ shared.subscribe([&sum, &count](int a) { sum += a; ++count; }) };
+
+			constexpr int producers{ 4 };
+			constexpr int perProducer{ 10000 };
+			std::vector<std::thread> workers;
+			for (int p{ 0 }; p < producers; ++p)
+			{
+				workers.emplace_back([&shared]()
+				{
+					for (int i{ 1 }; i <= perProducer; ++i)
+					{
+						shared.post(i);
+					}
+				});
+			}
+			size_t const expected{ static_cast<size_t>(producers) * perProducer };
+			while (count < expected)
+			{
+				shared.pump();
+			}
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+
+			long long const expectedSum{ static_cast<long long>(producers) * perProducer * (perProducer + 1) / 2 };
+			ASSERT_EQ(sum, expectedSum);
+			ASSERT_EQ(shared.stats().dropped, 0);
+			ASSERT_TRUE(shared.stats().high_water <= shared.capacity());
+		}
+
+		//the smallest coroutine type that can co_await: runs straight away, and is destroyed with its task
+		struct test_task
+		{
+			struct promise_type
+			{
+				test_task get_return_object() { return test_task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+				std::suspend_never initial_suspend() noexcept { return {}; }
+				std::suspend_always final_suspend() noexcept { return {}; }
+				void return_void() {}
+				void unhandled_exception() { std::abort(); }
+			};
+
+			std::coroutine_handle<promise_type> handle;
+
+			explicit test_task(std::coroutine_handle<promise_type> coroutine)
+				: handle{ coroutine }
+			{
+			}
+
+			test_task(test_task const&) = delete;
+			test_task& operator=(test_task const&) = delete;
+
+			~test_task()
+			{
+				if (handle)
+				{
+					handle.destroy();
+				}
+			}
+
+			bool done() const
+			{
+				return handle.done();
+			}
+		};
+
+		test_task wait_for_two(delegate<int>& source, std::vector<int>& received)
+		{
+			received.push_back(co_await source.next());
+			received.push_back(co_await source.next());
+		}
+
+		test_task wait_for_pair(delegate<int, std::string>& source, std::string& received)
+		{
+			auto [number, text] = co_await source.next();
+			received = text + std::to_string(number);
+		}
+
+		test_task wait_for_nothing(delegate<>& source, int& resumed)
+		{
+			co_await source.next();
+			++resumed;
+		}
+
+		void await_next()
+		{
+			delegate<int> source;
+			std::vector<int> received;
+			bool resumedEarly{ false };
+
+			//waiters are only resumed once every listener has run
+			delegate_handle listener{ source.subscribe([&received, &resumedEarly](int) { resumedEarly = resumedEarly || !received.empty(); }) };
+
+			test_task first{ wait_for_two(source, received) };
+			test_task second{ wait_for_two(source, received) };
+			ASSERT_TRUE(received.empty());
+
+			source(1);
+			ASSERT_TRUE(!resumedEarly);
+			ASSERT_EQ(received.size(), 2);
+			ASSERT_EQ(received[0], 1);
+			ASSERT_EQ(received[1], 1);
+			ASSERT_TRUE(!first.done());
+
+			//each co_await is one execution
+			source.invoke_move_last(2);
+			ASSERT_EQ(received.size(), 4);
+			ASSERT_EQ(received[3], 2);
+			ASSERT_TRUE(first.done());
+			ASSERT_TRUE(second.done());
+
+			//a batch counts as one execution, and waiters get its first event
+			test_task third{ wait_for_two(source, received) };
+			delegate<int>::argument_pack const batch[]{ { 5 }, { 6 } };
+			source.invoke_batch(batch);
+			ASSERT_EQ(received.size(), 5);
+			ASSERT_EQ(received[4], 5);
+
+			//destroying a waiting coroutine unlinks it
+			{
+				test_task abandoned{ wait_for_two(source, received) };
+			}
+			source(7);
+			ASSERT_EQ(received.size(), 6);
+			ASSERT_TRUE(third.done());
+
+			//several arguments come back as a tuple, none as nothing
+			delegate<int, std::string> pairs;
+			std::string text;
+			test_task pairTask{ wait_for_pair(pairs, text) };
+			pairs(3, "x");
+			ASSERT_EQ(text, "x3");
+
+			delegate<> empty;
+			int resumed{ 0 };
+			test_task emptyTask{ wait_for_nothing(empty, resumed) };
+			empty();
+			empty();
+			ASSERT_EQ(resumed, 1);
+		}
+
+		void intrusive_execute()
+		{
+			ASSERT_EQ(free_increment, 0);
+			example_class testObject;
+
+			intrusive_handle<int> outlives;
+			{
+				intrusive_delegate<int> source;
+				intrusive_handle<int> first{ source.subscribe(&fn_one_arg) };
+				intrusive_handle<int> second{ source.subscribe<&example_class::one_arg_function>(testObject) };
+				intrusive_handle<int> empty{ source.subscribe(nullptr) };
+				ASSERT_TRUE(!empty.is_subscribed());
+				ASSERT_EQ(source.subscriber_count(), 2);
+
+				source(2);
+				ASSERT_EQ(free_increment, 2);
+				ASSERT_EQ(testObject.local_value, 2);
+
+				//moving a handle keeps the subscription where it was
+				std::vector<int> order;
+				intrusive_handle<int> a{ source.subscribe([&order](int) { order.push_back(1); }) };
+				intrusive_handle<int> b{ source.subscribe([&order](int) { order.push_back(2); }) };
+				intrusive_handle<int> c{ source.subscribe([&order](int) { order.push_back(3); }) };
+				intrusive_handle<int> movedA{ std::move(a) };
+				ASSERT_TRUE(!a.is_subscribed());
+				b = std::move(c);
+				source(0);
+				ASSERT_EQ(order.size(), 2);
+				ASSERT_EQ(order[0], 1);
+				ASSERT_EQ(order[1], 3);
+				order.clear();
+
+				//changes made while executing: removed listeners are skipped, new ones wait for the next execution
+				intrusive_handle<int> late;
+				intrusive_handle<int> after;
+				intrusive_handle<int> changer{ source.subscribe([&after, &late, &source, &order](int)
+				{
+					after.unsubscribe();
+					if (!late.is_subscribed())
+					{
+						late = source.subscribe([&order](int) { order.push_back(4); });
+					}
+				}) };
+				intrusive_handle<int> mover{ source.subscribe([&movedA](int)
+				{
+					intrusive_handle<int> relocated{ std::move(movedA) };
+					movedA = std::move(relocated);
+				}) };
+				after = source.subscribe([&order](int) { order.push_back(5); });
+				source(0);
+				ASSERT_EQ(order.size(), 2);
+				ASSERT_EQ(order[0], 1);
+				ASSERT_EQ(order[1], 3);
+				order.clear();
+				source(0);
+				ASSERT_EQ(order.size(), 3);
+				ASSERT_EQ(order[2], 4);
+
+				//a listener can move the handle it is being called from, and carries on in the old one
+				{
+					struct
+					{
+						intrusive_handle<int> self;
+						intrusive_handle<int> kept;
+						std::vector<size_t> sizes;
+					} state;
+					intrusive_delegate<int> selfMoving;
+					state.self = selfMoving.subscribe([&state, payload = std::vector<int>(40)](int)
+					{
+						if (state.self.is_subscribed())
+						{
+							state.kept = std::move(state.self);
+						}
+						state.sizes.push_back(payload.size());
+					});
+					selfMoving(0);
+					ASSERT_TRUE(!state.self.is_subscribed());
+					ASSERT_TRUE(state.kept.is_subscribed());
+					selfMoving(0);
+					ASSERT_EQ(state.sizes.size(), 2);
+					ASSERT_EQ(state.sizes[0], 40);
+					ASSERT_EQ(state.sizes[1], 40);
+				}
+
+				//a listener can clear the delegate mid-execution
+				intrusive_handle<int> clearer{ source.subscribe([&source](int) { source.clear_all_subscriptions(); }) };
+				free_increment = 0;
+				source(1);
+				ASSERT_EQ(free_increment, 1);
+				ASSERT_EQ(source.subscriber_count(), 0);
+
+				outlives = source.subscribe(&fn_one_arg);
+				ASSERT_TRUE(outlives.is_subscribed());
+			}
+			//destroying the delegate detached the handle
+			ASSERT_TRUE(!outlives.is_subscribed());
+
+			free_increment = 0;
+			example_class::global_value = 0;
+		}
+
+		void keyed_execute()
+		{
+			keyed_delegate<int, int> damage;
+			std::vector<int> received;
+
+			delegate_handle first{ damage.subscribe(4711, [&received](int amount) { received.push_back(amount); }) };
+			delegate_handle second{ damage.subscribe(4711, [&received](int amount) { received.push_back(amount * 10); }) };
+			delegate_handle other{ damage.subscribe(42, [&received](int amount) { received.push_back(-amount); }) };
+			ASSERT_EQ(damage.key_count(), 2);
+			ASSERT_EQ(damage.subscriber_count(4711), 2);
+
+			//only the key's own listeners are called
+			damage(4711, 3);
+			ASSERT_EQ(received.size(), 2);
+			ASSERT_EQ(received[0] + received[1], 33);
+			received.clear();
+			damage(7, 3);
+			ASSERT_TRUE(received.empty());
+
+			//wildcard listeners hear every key, after the key's own listeners
+			std::vector<int> keys;
+			delegate_handle all{ damage.subscribe_all([&keys](int const& key, int) { keys.push_back(key); }) };
+			damage(42, 1);
+			damage(7, 1);
+			ASSERT_EQ(received.size(), 1);
+			ASSERT_EQ(received[0], -1);
+			ASSERT_EQ(keys.size(), 2);
+			ASSERT_EQ(keys[0], 42);
+			ASSERT_EQ(keys[1], 7);
+			received.clear();
+			keys.clear();
+
+			//handles move freely, and a key is dropped with its last listener
+			delegate_handle moved{ std::move(other) };
+			damage(42, 1);
+			ASSERT_EQ(received.size(), 1);
+			moved.unsubscribe();
+			ASSERT_EQ(damage.key_count(), 1);
+			ASSERT_EQ(damage.subscriber_count(42), 0);
+			received.clear();
+
+			//changes made while executing: removed listeners are skipped, new ones wait for the next execution
+			//kept together, so the listener below only needs to capture two things
+			struct
+			{
+				delegate_handle first;
+				delegate_handle second;
+				delegate_handle late;
+				std::vector<int>& received;
+				bool subscribedLate;
+			} changes{ std::move(first), std::move(second), {}, received, false };
+			delegate_handle changer{ damage.subscribe(4711, [&damage, &changes](int)
+			{
+				changes.first.unsubscribe();
+				changes.second.unsubscribe();
+				if (!changes.subscribedLate)
+				{
+					changes.late = damage.subscribe(99, [&received = changes.received](int amount) { received.push_back(amount + 1000); });
+					changes.subscribedLate = true;
+				}
+			}) };
+			damage(4711, 5);
+			//first and second may or may not have run before changer did
+			ASSERT_TRUE(received.size() <= 2);
+			received.clear();
+			damage(4711, 5);
+			ASSERT_TRUE(received.empty());
+			damage(99, 5);
+			ASSERT_EQ(received.size(), 1);
+			ASSERT_EQ(received[0], 1005);
+			received.clear();
+
+			//keys that collide in the table: 11 and 27 want the same position, and 10 the one after.
+			//removing 11 must still leave 27 reachable past 10
+			{
+				keyed_delegate<int, int> colliding;
+				int calls{ 0 };
+				delegate_handle eleven{ colliding.subscribe(11, [&calls](int) { ++calls; }) };
+				delegate_handle ten{ colliding.subscribe(10, [&calls](int) { ++calls; }) };
+				delegate_handle twentySeven{ colliding.subscribe(27, [&calls](int) { ++calls; }) };
+				eleven.unsubscribe();
+				ASSERT_EQ(colliding.subscriber_count(27), 1);
+				colliding(27, 0);
+				ASSERT_EQ(calls, 1);
+				delegate_handle again{ colliding.subscribe(27, [&calls](int) { ++calls; }) };
+				ASSERT_EQ(colliding.key_count(), 2);
+				colliding(27, 0);
+				ASSERT_EQ(calls, 3);
+			}
+
+			//handles of a cleared or destroyed delegate are left harmless, so they may outlive it
+			{
+				delegate_handle outlives;
+				delegate_handle outlivesCleared;
+				{
+					keyed_delegate<int, int> temporary;
+					outlivesCleared = temporary.subscribe(1, [](int) {});
+					delegate_handle wildcard{ temporary.subscribe_all([](int const&, int) {}) };
+					temporary.clear_all_subscriptions();
+					outlives = temporary.subscribe(2, [](int) {});
+					delegate_handle moved{ std::move(outlives) };
+					outlives = std::move(moved);
+				}
+				outlivesCleared.unsubscribe();
+			}
+
+			//lots of keys, to exercise growing and shrinking the table
+			std::vector<delegate_handle> handles;
+			int total{ 0 };
+			for (int key{ 0 }; key < 1000; ++key)
+			{
+				handles.push_back(damage.subscribe(key * 1024, [&total](int amount) { total += amount; }));
+			}
+			for (int key{ 0 }; key < 1000; key += 2)
+			{
+				handles[static_cast<size_t>(key)].unsubscribe();
+			}
+			for (int key{ 0 }; key < 1000; ++key)
+			{
+				damage(key * 1024, 1);
+			}
+			ASSERT_EQ(total, 500);
+
+			//clearing from a listener stops the rest of the execution
+			keys.clear();
+			delegate_handle clearer{ damage.subscribe(4711, [&damage](int) { damage.clear_all_subscriptions(); }) };
+			damage(4711, 1);
+			ASSERT_TRUE(keys.empty());
+			ASSERT_EQ(damage.subscriber_count(), 0);
+			ASSERT_EQ(damage.key_count(), 0);
+			ASSERT_EQ(damage.key_count(), 0);
+			damage(4711, 1);
+			damage(99, 1);
+			ASSERT_TRUE(received.empty());
+			ASSERT_TRUE(keys.empty());
+		}
+
+		void coalesce_flush()
+		{
+			//last_wins: many raises, one call with the newest arguments
+			coalescing_delegate<std::string const&> layout;
+			std::vector<std::string> seen;
+			delegate_handle handle{ layout.subscribe([&seen](std::string const& reason) { seen.push_back(reason); }) };
+			ASSERT_TRUE(!layout.flush());
+			layout.raise("resize");
+			layout.raise("font");
+			layout.raise("scroll");
+			ASSERT_TRUE(layout.is_pending());
+			ASSERT_TRUE(seen.empty());
+			ASSERT_TRUE(layout.flush());
+			ASSERT_EQ(seen.size(), 1);
+			ASSERT_EQ(seen[0], "scroll");
+			ASSERT_TRUE(!layout.is_pending());
+			ASSERT_EQ(layout.stats().raised, 3);
+			ASSERT_EQ(layout.stats().dispatched, 1);
+			ASSERT_EQ(layout.stats().elided, 2);
+
+			//executing it directly still calls everyone straight away
+			layout(std::string{ "now" });
+			ASSERT_EQ(seen.size(), 2);
+
+			//first_wins
+			coalescing_delegate<int> first{ coalesce_policy::first_wins };
+			int got{ 0 };
+			delegate_handle firstHandle{ first.subscribe([&got](int value) { got = value; }) };
+			first.raise(1);
+			first.raise(2);
+			first.flush();
+			ASSERT_EQ(got, 1);
+
+			//a reducer merges every raise
+			coalescing_delegate<int, int> damage{ [](int& total, int& hits, int const& amount, int const&) { total += amount; ++hits; } };
+			ASSERT_TRUE(damage.policy() == coalesce_policy::reduce);
+			int total{ 0 };
+			int hits{ 0 };
+			delegate_handle damageHandle{ damage.subscribe([&total, &hits](int amount, int count) { total = amount; hits = count; }) };
+			damage.raise(5, 1);
+			damage.raise(7, 0);
+			damage.raise(3, 0);
+			damage.flush();
+			ASSERT_EQ(total, 15);
+			ASSERT_EQ(hits, 3);
+
+			//raising from a listener waits for the next flush
+			coalescing_delegate<int> again;
+			int calls{ 0 };
+			delegate_handle againHandle{ again.subscribe([&again, &calls](int value)
+			{
+				++calls;
+				if (value < 3)
+				{
+					again.raise(value + 1);
+				}
+			}) };
+			again.raise(0);
+			again.flush();
+			ASSERT_EQ(calls, 1);
+			ASSERT_TRUE(again.is_pending());
+			while (again.flush())
+			{
+			}
+			ASSERT_EQ(calls, 4);
+
+			//flushing from a listener does nothing: the raised event waits for the next flush
+			coalescing_delegate<int> nested;
+			std::vector<int> values;
+			delegate_handle nestedHandle{ nested.subscribe([&nested, &values](int value)
+			{
+				values.push_back(value);
+				if (value == 0)
+				{
+					nested.raise(1);
+					ASSERT_TRUE(!nested.flush());
+				}
+			}) };
+			nested.raise(0);
+			ASSERT_TRUE(nested.flush());
+			ASSERT_EQ(values.size(), 1);
+			ASSERT_TRUE(nested.is_pending());
+			ASSERT_TRUE(nested.flush());
+			ASSERT_EQ(values.size(), 2);
+			ASSERT_EQ(values[1], 1);
+
+			//keyed: one event per key, in the order the keys were first raised, and the last listener may move
+			keyed_coalescing_delegate<int, copy_counter> moved;
+			std::vector<int> keys;
+			delegate_handle keyHandle{ moved.subscribe([&keys](int key, copy_counter taken) { keys.push_back(key); (void)taken; }) };
+			copy_counter::reset();
+			copy_counter value;
+			moved.raise(9, value);
+			moved.raise(4, value);
+			moved.raise(9, value);
+			ASSERT_EQ(moved.pending_count(), 2);
+			ASSERT_EQ(moved.flush(), 2);
+			ASSERT_EQ(keys.size(), 2);
+			ASSERT_EQ(keys[0], 9);
+			ASSERT_EQ(keys[1], 4);
+			//one copy per raise into the waiting events, then the listener taking it by value only moves
+			ASSERT_EQ(copy_counter::copies, 3);
+			ASSERT_EQ(moved.pending_count(), 0);
+			ASSERT_EQ(moved.flush(), 0);
+			ASSERT_EQ(moved.stats().elided, 1);
+		}
+
+		void affinity_execute()
+		{
+			affinity_delegate<std::string const&> loaded;
+			executor_queue here;
+			executor_queue render;
+			//render's thread is elsewhere, so its listeners get queued
+			std::thread{ [&render]() { render.bind_to_current_thread(); } }.join();
+			ASSERT_TRUE(here.runs_here());
+			ASSERT_TRUE(!render.runs_here());
+
+			std::vector<std::string> inlineSeen;
+			std::vector<std::string> renderSeen;
+			delegate_handle plain{ loaded.subscribe([&inlineSeen](std::string const& name) { inlineSeen.push_back(name); }) };
+			delegate_handle local{ loaded.subscribe([&inlineSeen](std::string const& name) { inlineSeen.push_back(name + "!"); }, &here) };
+			delegate_handle first{ loaded.subscribe([&renderSeen](std::string const& name) { renderSeen.push_back(name); }, &render) };
+			delegate_handle second{ loaded.subscribe([&renderSeen](std::string const& name) { renderSeen.push_back(name + "?"); }, &render) };
+			ASSERT_EQ(loaded.subscriber_count(), 4);
+
+			{
+				std::string name{ "mesh" };
+				loaded(name);
+			}
+			//the executing thread's listeners ran right away, the render ones share one queued task
+			ASSERT_EQ(inlineSeen.size(), 2);
+			ASSERT_TRUE(renderSeen.empty());
+			ASSERT_EQ(render.pending(), 1);
+			ASSERT_EQ(here.pending(), 0);
+
+			//the arguments were copied, so they outlive the call
+			ASSERT_EQ(render.run_pending(), 1);
+			ASSERT_EQ(renderSeen.size(), 2);
+			ASSERT_EQ(renderSeen[0], "mesh");
+			ASSERT_EQ(renderSeen[1], "mesh?");
+
+			//unsubscribing drops calls that are already queued
+			loaded(std::string{ "texture" });
+			second.unsubscribe();
+			render.run_pending();
+			ASSERT_EQ(renderSeen.size(), 3);
+			ASSERT_EQ(renderSeen[2], "texture");
+
+			//moved handles keep their subscription
+			delegate_handle moved{ std::move(first) };
+			loaded(std::string{ "sound" });
+			render.run_pending();
+			ASSERT_EQ(renderSeen.size(), 4);
+
+			loaded.clear_all_subscriptions();
+			ASSERT_EQ(loaded.subscriber_count(), 0);
+			loaded(std::string{ "nothing" });
+			ASSERT_EQ(render.pending(), 0);
+
+			//an empty function isn't subscribed, so executing doesn't call it
+			delegate_handle empty{ loaded.subscribe(nullptr) };
+			ASSERT_EQ(loaded.subscriber_count(), 0);
+			loaded(std::string{ "still nothing" });
+
+			//handles are detached when the delegate is destroyed, so they may outlive it
+			{
+				delegate_handle outlives;
+				{
+					affinity_delegate<int> temporary;
+					outlives = temporary.subscribe([](int) {}, &render);
+					temporary(1);
+					affinity_delegate<int> const& inspected{ temporary };
+					ASSERT_GT(inspected.memory_usage(), 0);
+				}
+				delegate_handle moved{ std::move(outlives) };
+				//the queued call kept what it needed, and is dropped
+				ASSERT_EQ(render.run_pending(), 1);
+			}
+
+			//snapshots, listeners and queued arguments all come from the delegate's resource
+			counting_resource upstream;
+			{
+				affinity_delegate<std::string const&> pooled{ &upstream };
+				delegate_handle queuedHandle{ pooled.subscribe([&renderSeen](std::string const& name) { renderSeen.push_back(name); }, &render) };
+				size_t const subscribed{ upstream.outstanding };
+				ASSERT_GT(subscribed, 0);
+				pooled(std::string{ "pooled" });
+				ASSERT_GT(upstream.outstanding, subscribed);
+				ASSERT_EQ(render.run_pending(), 1);
+				ASSERT_EQ(renderSeen.back(), "pooled");
+				ASSERT_EQ(upstream.outstanding, subscribed);
+			}
+			ASSERT_EQ(upstream.outstanding, 0);
+
+			//a real render thread, draining its queue until told to stop
+			affinity_delegate<int> frame;
+			executor_queue worker;
+			std::atomic<bool> ready{ false };
+			std::atomic<bool> stop{ false };
+			std::atomic<int> total{ 0 };
+			std::atomic<int> calls{ 0 };
+			delegate_handle sum{ frame.subscribe([&total](int value) { total += value; }, &worker) };
+			delegate_handle count{ frame.subscribe([&calls](int) { ++calls; }, &worker) };
+			std::thread renderer{ [&]()
+			{
+				worker.bind_to_current_thread();
+				ready = true;
+				while (!stop)
+				{
+					worker.run_pending();
+					std::this_thread::yield();
+				}
+				worker.run_pending();
+			} };
+			while (!ready)
+			{
+				std::this_thread::yield();
+			}
+			for (int i{ 1 }; i <= 100; ++i)
+			{
+				frame(i);
+			}
+			stop = true;
+			renderer.join();
+			ASSERT_EQ(total.load(), 5050);
+			ASSERT_EQ(calls.load(), 100);
+		}
+
+		/*
+		* Test compact_delegate, and memory_usage() across the delegates, particularly the following:
+		*    - Each subscription is one 24 byte entry, and holes are reused
+		*    - Stale handles can't remove whoever reused their entry
+		*    - Subscribing and unsubscribing while executing
+		*/
+		void compact_execute()
+		{
+			free_increment = 0;
+			example_class testObject;
+
+			compact_delegate<int> compact;
+			ASSERT_EQ(compact.memory_usage(), 0);
+			compact.reserve(1000);
+			if constexpr (sizeof(void*) == 8)
+			{
+				ASSERT_EQ(compact.memory_usage(), 24000);
+			}
+
+			int total{ 0 };
+			delegate_handle member{ compact.subscribe<&example_class::one_arg_function>(testObject) };
+			delegate_handle freeHandle{ compact.subscribe<&fn_one_arg>() };
+			delegate_handle pointer{ compact.subscribe(&fn_one_arg) };
+			delegate_handle lambda{ compact.subscribe([&total](int value) { total += value; }) };
+			ASSERT_EQ(compact.subscriber_count(), 4);
+			compact(3);
+			ASSERT_EQ(testObject.local_value, 3);
+			ASSERT_EQ(free_increment, 6);
+			ASSERT_EQ(total, 3);
+
+			//clearing detaches the handles, so the one whose hole is filled first can't remove the new subscription
+			delegate_handle stale{ std::move(lambda) };
+			compact.clear_all_subscriptions();
+			ASSERT_EQ(compact.subscriber_count(), 0);
+			delegate_handle refilled{ compact.subscribe([&total](int value) { total += value * 10; }) };
+			stale.unsubscribe();
+			member.unsubscribe();
+			ASSERT_EQ(compact.subscriber_count(), 1);
+			compact(1);
+			ASSERT_EQ(total, 13);
+			ASSERT_EQ(testObject.local_value, 3);
+
+			//moved handles keep their subscription, and removing it is constant time wherever it is
+			{
+				delegate_handle moved{ std::move(refilled) };
+				compact(1);
+				ASSERT_EQ(total, 23);
+			}
+			ASSERT_EQ(compact.subscriber_count(), 0);
+
+			//during an execution: the removed listener isn't called, the added one waits for the next
+			//(on a new delegate, since which of these is called first depends on which holes they got)
+			compact_delegate<int> reentrant;
+			struct reentrant_state
+			{
+				compact_delegate<int>* source;
+				std::vector<delegate_handle> added;
+				delegate_handle victim;
+				int calls;
+			} state{ &reentrant, {}, {}, 0 };
+			delegate_handle adder{ reentrant.subscribe([&state](int)
+			{
+				++state.calls;
+				state.victim.unsubscribe();
+				state.added.push_back(state.source->subscribe([&state](int) { state.calls += 100; }));
+			}) };
+			state.victim = reentrant.subscribe([&state](int) { state.calls += 1000; });
+			reentrant(0);
+			ASSERT_EQ(state.calls, 1);
+			ASSERT_EQ(reentrant.subscriber_count(), 2);
+			reentrant(0);
+			ASSERT_EQ(state.calls, 102);
+			ASSERT_EQ(reentrant.subscriber_count(), 3);
+			state.added.clear();
+			adder.unsubscribe();
+			ASSERT_EQ(reentrant.subscriber_count(), 0);
+
+			//a listener that resubscribes itself every execution reuses its old entry, rather than growing the array
+			struct resubscriber
+			{
+				compact_delegate<int>* source;
+				delegate_handle self;
+				int calls;
+
+				void on_event(int)
+				{
+					++calls;
+					self = source->subscribe<&resubscriber::on_event>(this);
+				}
+			} churn{ &reentrant, {}, 0 };
+			churn.self = reentrant.subscribe<&resubscriber::on_event>(&churn);
+			delegate_handle steady{ reentrant.subscribe([](int) {}) };
+			reentrant(0);
+			size_t const settled{ reentrant.memory_usage() };
+			for (int i{ 0 }; i < 1000; ++i)
+			{
+				reentrant(0);
+			}
+			ASSERT_EQ(churn.calls, 1001);
+			ASSERT_EQ(reentrant.subscriber_count(), 2);
+			ASSERT_EQ(reentrant.memory_usage(), settled);
+
+			//handles are detached when the delegate is cleared or destroyed, so they may outlive it
+			{
+				delegate_handle outlives;
+				delegate_handle outlivesCleared;
+				{
+					compact_delegate<int> temporary;
+					outlivesCleared = temporary.subscribe(&fn_one_arg);
+					temporary.clear_all_subscriptions();
+					outlives = temporary.subscribe<&fn_one_arg>();
+					delegate_handle moved{ std::move(outlives) };
+					outlives = std::move(moved);
+				}
+				outlivesCleared.unsubscribe();
+			}
+
+			//every delegate reports what it has allocated for its subscriptions
+			delegate<int> slow;
+			delegate_fast<int> fast;
+			keyed_delegate<int, int> keyed;
+			event_bus bus;
+			{
+				delegate_handle slowHandle{ slow.subscribe(&fn_one_arg) };
+				delegate_handle fastHandle{ fast.subscribe(&fn_one_arg) };
+				delegate_handle keyedHandle{ keyed.subscribe(1, &fn_one_arg) };
+				delegate_handle busHandle{ bus.subscribe<int>(&fn_one_arg) };
+				ASSERT_TRUE(slow.memory_usage() > 0);
+				ASSERT_TRUE(fast.memory_usage() > 0);
+				ASSERT_TRUE(keyed.memory_usage() > 0);
+				ASSERT_TRUE(bus.memory_usage() > fast.memory_usage());
+			}
+			ASSERT_EQ(slow.memory_usage(), 0);
+			static_assert(static_delegate<listeners<&fn_one_arg>, int>::memory_usage() == 0);
+			free_increment = 0;
+		}
+
+		/*
+		* Run a test and print the result.
+		* Currently tests will fail asserts when something goes wrong, so this will only ever output success messages.
+		*
+		* Params:
+		*   - test
+		*       A pointer to the test function to run.
+		*   - label
+		*       What the test should be called in the console.
+		*/
+		void run_test(void(*test)(), std::string const& label)
+		{
+			std::cout << "=======RUNNING TEST " << label << "=======" << std::endl;
+			test();
+			std::cout << "|||||||TEST COMPLETE||||||" << std::endl;
+		}
+	}
+}
+
+int main()
+{
+	using namespace yadi::tests;
+
+	run_test(util_functions, "util");
+	run_test(basic_subscribe, "subscribe");
+	run_test(basic_unsubscribe, "unsubscribe");
+	run_test(delayed_subscribe, "delayed subscribe");
+	run_test(various_execute, "execute");
+	run_test(fast_delegate, "delegate_fast");
+	run_test(inplace_functions, "inplace_function");
+	run_test(bound_subscribe, "bound subscribe");
+	run_test(concurrent_execute, "concurrent_delegate");
+	run_test(parallel_execute, "dispatch_parallel");
+	run_test(queued_execute, "event_queue");
+	run_test(batched_execute, "invoke_batch");
+	run_test(reentrant_execute, "reentrant execute");
+	run_test(slot_handles, "slot handles");
+	run_test(grouped_unsubscribe, "subscription_group");
+	run_test(pooled_subscribe, "subscription_pool");
+	run_test(instrumented_execute, "instrumentation");
+	run_test(zero_copy_execute, "zero copy execute");
+	run_test(static_execute, "static_delegate");
+	run_test(bus_publish, "event_bus");
+	run_test(channel_pump, "delegate_channel");
+	run_test(await_next, "co_await next()");
+	run_test(intrusive_execute, "intrusive_delegate");
+	run_test(keyed_execute, "keyed_delegate");
+	run_test(coalesce_flush, "coalescing_delegate");
+	run_test(affinity_execute, "affinity_delegate");
+	run_test(compact_execute, "compact_delegate");
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+/*********************************************************************************************
+
+	This compiles the delegate signatures that test_cases.cpp declares extern.
+
+	Since it includes every YADI header, just like test_cases.cpp does, it also makes sure
+	nothing in the headers gets defined twice when they're used from more than one file.
+
+**********************************************************************************************/
+
+#include "../YADI/delegate.hpp"
+#include "../YADI/delegate_fast.hpp"
+#include "../YADI/delegate_interruptible.hpp"
+#include "../YADI/delegate_concurrent.hpp"
+#include "../YADI/delegate_parallel.hpp"
+#include "../YADI/delegate_queue.hpp"
+#include "../YADI/delegate_group.hpp"
+#include "../YADI/delegate_pool.hpp"
+#include "../YADI/delegate_static.hpp"
+#include "../YADI/delegate_bus.hpp"
+#include "../YADI/delegate_channel.hpp"
+#include "../YADI/delegate_intrusive.hpp"
+#include "../YADI/delegate_keyed.hpp"
+#include "../YADI/delegate_coalescing.hpp"
+#include "../YADI/delegate_affinity.hpp"
+#include "../YADI/delegate_compact.hpp"
+
+YADI_COMMON_SIGNATURES(YADI_INSTANTIATE_DELEGATE);
+YADI_COMMON_SIGNATURES(YADI_INSTANTIATE_DELEGATE_FAST);